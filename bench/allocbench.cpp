@@ -0,0 +1,97 @@
+#include <rxqt.hpp>
+#include <QtTest/QtTest>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+Q_LOGGING_CATEGORY(rxqtEventLoop, "rxqt.eventloop")
+
+namespace rxsc=rxcpp::schedulers;
+
+namespace {
+
+std::atomic<std::uint64_t> allocations(0);
+
+}
+
+// Counts every heap allocation in the process. This is why the allocation
+// rows live in a binary of their own: the counter slows every other row.
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+class BenchAllocations : public QObject
+{
+    Q_OBJECT
+private slots:
+    void allocations_data()
+    {
+        QTest::addColumn<int>("kind");
+        QTest::newRow("immediate item") << 0;
+        QTest::newRow("timed item, cancelled") << 1;
+        QTest::newRow("worker per subscription") << 2;
+    }
+
+    // heap allocations per operation on the loop thread, after a warm-up
+    // pass has filled the pools
+    void allocations()
+    {
+        QFETCH(int, kind);
+        const int rounds = 10000;
+        auto sc = rxsc::make_qt_event_loop(rxsc::qt_event_loop_options());
+        rxcpp::composite_subscription cs;
+        auto w = sc.create_worker(cs);
+        auto action = rxsc::make_action([](const rxsc::schedulable&) {});
+
+        auto pass = [&]() {
+            for (int i = 0; i != rounds; ++i) {
+                switch (kind) {
+                case 0:
+                    w.schedule(action);
+                    break;
+                case 1: {
+                    rxcpp::composite_subscription timeout;
+                    w.schedule(w.now() + std::chrono::seconds(10), rxsc::make_schedulable(w, timeout, action));
+                    timeout.unsubscribe();
+                    break;
+                }
+                default: {
+                    rxcpp::composite_subscription lifetime;
+                    auto transient = sc.create_worker(lifetime);
+                    transient.schedule(action);
+                    lifetime.unsubscribe();
+                    break;
+                }
+                }
+                if (i % 64 == 63) {
+                    QCoreApplication::processEvents();
+                }
+            }
+            QCoreApplication::processEvents();
+        };
+
+        pass();
+        auto before = allocations.load();
+        pass();
+        qInfo() << "allocations per operation:" << double(allocations.load() - before) / rounds;
+        cs.unsubscribe();
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchAllocations)
+#include "allocbench.moc"
@@ -0,0 +1,16 @@
+QT += core testlib
+
+CONFIG += c++14
+CONFIG += release
+
+TARGET = rxbench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../Rx/v2/src
+INCLUDEPATH += ../include
+
+SOURCES += \
+    eventloopbench.cpp
@@ -0,0 +1,679 @@
+#include <rxqt.hpp>
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+
+Q_LOGGING_CATEGORY(rxqtEventLoop, "rxqt.eventloop")
+
+namespace rxsc=rxcpp::schedulers;
+
+namespace {
+
+const int item_count = 100000;
+
+// The wakeup scheme qt_event_loop used before wakeups were coalesced: every
+// push constructs a throw-away QObject whose destroyed() signal drains the
+// queue through a (queued, when crossing threads) connection.
+class legacy_stub_sink : public QObject
+{
+public:
+    void push(std::function<void()> f)
+    {
+        QObject stub; {
+            std::unique_lock<std::mutex> guard(lock);
+            q.push_back(std::move(f));
+            guard.unlock();
+
+            QObject::connect(&stub, &QObject::destroyed, this, [this]() {
+                drain();
+            });
+        }
+    }
+
+private:
+    void drain()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!q.empty()) {
+            auto f = std::move(q.front());
+            q.pop_front();
+            guard.unlock();
+            f();
+            guard.lock();
+        }
+    }
+
+    std::mutex lock;
+    std::deque<std::function<void()>> q;
+};
+
+// Pushes item_count items split across producer threads and spins the
+// calling thread's event loop until all of them have run.
+template<class Schedule>
+void run_cross_thread(Schedule schedule, int producer_count = 1)
+{
+    std::atomic<int> done(0);
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::thread> producers;
+    for (int p = 0; p != producer_count; ++p) {
+        producers.emplace_back([&]() {
+            for (int i = 0; i != item_count / producer_count; ++i) {
+                schedule([&done]() { ++done; });
+            }
+        });
+    }
+    while (done.load() != item_count / producer_count * producer_count) {
+        QCoreApplication::processEvents();
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    qInfo() << "items/sec:" << qint64(item_count * 1e9 / timer.nsecsElapsed());
+}
+
+// Schedules delayed items between 100us and 5ms out and reports how late
+// they ran relative to their deadline.
+void run_jitter(const rxsc::scheduler& sc)
+{
+    const int samples = 2000;
+    rxcpp::composite_subscription cs;
+    auto w = sc.create_worker(cs);
+    std::vector<qint64> lateness;
+    lateness.reserve(samples);
+    for (int i = 0; i != samples; ++i) {
+        auto when = w.now() + std::chrono::microseconds(100 + (i * 4900) / samples);
+        bool done = false;
+        w.schedule(when, [&, when](const rxsc::schedulable&) {
+            lateness.push_back(std::chrono::duration_cast<std::chrono::microseconds>(w.now() - when).count());
+            done = true;
+        });
+        while (!done) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+    }
+    cs.unsubscribe();
+    std::sort(lateness.begin(), lateness.end());
+    qInfo() << "lateness us: median" << lateness[samples / 2]
+            << "p99" << lateness[samples * 99 / 100]
+            << "max" << lateness.back();
+}
+
+}
+
+class SignalSource : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int level READ level WRITE setLevel NOTIFY levelChanged)
+public:
+    int level() const
+    {
+        return current;
+    }
+
+    void setLevel(int level)
+    {
+        current = level;
+        emit levelChanged();
+    }
+
+signals:
+    void levelChanged();
+    void value(int);
+    void payload(const std::vector<double>&, int);
+
+private:
+    int current = 0;
+};
+
+// What from_event used to install: one filter per subscription, each
+// checking the type itself.
+class legacy_event_filter : public QObject
+{
+public:
+    legacy_event_filter(QObject* parent, QEvent::Type type, std::function<void(QEvent*)> f)
+        : QObject(parent), type(type), f(std::move(f))
+    {
+    }
+
+    bool eventFilter(QObject* obj, QEvent* event)
+    {
+        if (event->type() == type) {
+            f(event);
+        }
+        return QObject::eventFilter(obj, event);
+    }
+
+private:
+    QEvent::Type type;
+    std::function<void(QEvent*)> f;
+};
+
+class BenchEventLoop : public QObject
+{
+    Q_OBJECT
+private slots:
+    void schedule_legacy_stub()
+    {
+        legacy_stub_sink sink;
+        QBENCHMARK {
+            run_cross_thread([&sink](std::function<void()> f) {
+                sink.push(std::move(f));
+            });
+        }
+    }
+
+    void schedule_coalesced()
+    {
+        rxcpp::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop().create_worker(cs);
+        QBENCHMARK {
+            run_cross_thread([&w](std::function<void()> f) {
+                w.schedule([f](const rxsc::schedulable&) { f(); });
+            });
+        }
+        cs.unsubscribe();
+    }
+
+    void schedule_many_producers()
+    {
+        rxcpp::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop().create_worker(cs);
+        QBENCHMARK {
+            run_cross_thread([&w](std::function<void()> f) {
+                w.schedule([f](const rxsc::schedulable&) { f(); });
+            }, 4);
+        }
+        cs.unsubscribe();
+    }
+
+    void schedule_with_drain_budget()
+    {
+        rxsc::qt_event_loop_options options;
+        options.max_items_per_drain = 256;
+        options.max_drain_time = std::chrono::milliseconds(4);
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+
+        rxcpp::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        QBENCHMARK {
+            run_cross_thread([&w](std::function<void()> f) {
+                w.schedule([f](const rxsc::schedulable&) { f(); });
+            }, 4);
+        }
+        cs.unsubscribe();
+        qInfo() << "drains:" << options.stats->drains.load()
+                << "item budget hits:" << options.stats->item_budget_hits.load()
+                << "time budget hits:" << options.stats->time_budget_hits.load();
+        auto m = options.stats->metrics();
+        qInfo() << "peak depth:" << m.peak_queue_depth
+                << "latency us: p50" << m.latency_p50.count()
+                << "p99" << m.latency_p99.count()
+                << "max" << m.latency_max.count()
+                << "longest action us:" << m.longest_action.count();
+    }
+
+    // same load as schedule_many_producers, with every event recorded
+    void schedule_traced()
+    {
+        rxsc::qt_event_loop_options options;
+        options.tracer = std::make_shared<rxsc::qt_event_loop_tracer>();
+
+        rxcpp::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        QBENCHMARK {
+            run_cross_thread([&w](std::function<void()> f) {
+                w.schedule([f](const rxsc::schedulable&) { f(); });
+            }, 4);
+        }
+        cs.unsubscribe();
+        qInfo() << "records kept:" << options.tracer->snapshot().size();
+    }
+
+    void observe_on_latency_data()
+    {
+        QTest::addColumn<bool>("inline_delivery");
+        QTest::newRow("queued") << false;
+        QTest::newRow("inline") << true;
+    }
+
+    // one value at a time from the loop thread itself, until delivered
+    void observe_on_latency()
+    {
+        QFETCH(bool, inline_delivery);
+        auto coordination = inline_delivery
+            ? rxcpp::observe_on_qt_event_loop_inline()
+            : rxcpp::observe_on_qt_event_loop();
+        rxcpp::subjects::subject<int> values;
+        int received = 0;
+        auto subscription = values.get_observable()
+            .observe_on(coordination)
+            .subscribe([&received](int) { ++received; });
+        auto input = values.get_subscriber();
+        QBENCHMARK {
+            int expected = received + 1;
+            input.on_next(expected);
+            while (received != expected) {
+                QCoreApplication::processEvents();
+            }
+        }
+        subscription.unsubscribe();
+    }
+
+    void outstanding_timers_data()
+    {
+        QTest::addColumn<int>("storage");
+        QTest::addColumn<int>("count");
+        for (int count : {10000, 100000}) {
+            QTest::newRow(qPrintable(QString("heap %1").arg(count))) << int(rxsc::qt_timer_storage::heap) << count;
+            QTest::newRow(qPrintable(QString("wheel %1").arg(count))) << int(rxsc::qt_timer_storage::wheel) << count;
+        }
+    }
+
+    // timeout-style load: schedule count items 1 to 60 s out, then cancel
+    // nine in ten of them
+    void outstanding_timers()
+    {
+        QFETCH(int, storage);
+        QFETCH(int, count);
+        rxsc::qt_event_loop_options options;
+        options.timer_storage = static_cast<rxsc::qt_timer_storage>(storage);
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+        auto sc = rxsc::make_qt_event_loop(options);
+        std::int64_t live = 0;
+        std::int64_t dead = 0;
+
+        QBENCHMARK {
+            rxcpp::composite_subscription cs;
+            auto w = sc.create_worker(cs);
+            std::vector<rxcpp::composite_subscription> timeouts(count);
+            auto now = w.now();
+            for (int i = 0; i != count; ++i) {
+                auto when = now + std::chrono::milliseconds(1000 + (i * 7919) % 59000);
+                w.schedule(when, rxsc::make_schedulable(w, timeouts[i], [](const rxsc::schedulable&) {}));
+            }
+            QCoreApplication::processEvents();
+            for (int i = 0; i != count; ++i) {
+                if (i % 10 != 0) {
+                    timeouts[i].unsubscribe();
+                }
+            }
+            QCoreApplication::processEvents();
+            live = options.stats->timed_live.load();
+            dead = options.stats->timed_dead.load();
+            cs.unsubscribe();
+        }
+        qInfo() << "after cancelling, live:" << live << "dead:" << dead;
+    }
+
+    void input_latency_under_load_data()
+    {
+        QTest::addColumn<bool>("lanes");
+        QTest::newRow("single lane") << false;
+        QTest::newRow("lanes") << true;
+    }
+
+    // a burst of 1000 background items of ~5us each lands right before
+    // every input item, reports how long the input item waited
+    void input_latency_under_load()
+    {
+        QFETCH(bool, lanes);
+        rxcpp::composite_subscription cs;
+        auto background = rxsc::make_qt_event_loop(lanes ? rxsc::qt_event_loop_priority::background : rxsc::qt_event_loop_priority::normal).create_worker(cs);
+        auto input = rxsc::make_qt_event_loop(lanes ? rxsc::qt_event_loop_priority::interactive : rxsc::qt_event_loop_priority::normal).create_worker(cs);
+        const int samples = 200;
+        std::vector<qint64> latency;
+        latency.reserve(samples);
+        for (int i = 0; i != samples; ++i) {
+            for (int j = 0; j != 1000; ++j) {
+                background.schedule([](const rxsc::schedulable&) {
+                    auto until = rxsc::scheduler::clock_type::now() + std::chrono::microseconds(5);
+                    while (rxsc::scheduler::clock_type::now() < until) {
+                    }
+                });
+            }
+            auto requested = input.now();
+            bool done = false;
+            input.schedule([&](const rxsc::schedulable&) {
+                latency.push_back(std::chrono::duration_cast<std::chrono::microseconds>(input.now() - requested).count());
+                done = true;
+            });
+            while (!done) {
+                QCoreApplication::processEvents();
+            }
+        }
+        cs.unsubscribe();
+        std::sort(latency.begin(), latency.end());
+        qInfo() << "input latency us: median" << latency[samples / 2]
+                << "p99" << latency[samples * 99 / 100]
+                << "max" << latency.back();
+    }
+
+    void emit_after_churn_data()
+    {
+        QTest::addColumn<int>("cycles");
+        QTest::newRow("0") << 0;
+        QTest::newRow("1000") << 1000;
+        QTest::newRow("10000") << 10000;
+    }
+
+    // emit cost with one live subscriber after cycles subscribe/unsubscribe
+    // rounds, which must leave no connections behind
+    void emit_after_churn()
+    {
+        QFETCH(int, cycles);
+        SignalSource source;
+        for (int i = 0; i != cycles; ++i) {
+            rxqt::from_signal(&source, &SignalSource::value).subscribe([](int) {}).unsubscribe();
+        }
+        int received = 0;
+        auto subscription = rxqt::from_signal(&source, &SignalSource::value).subscribe([&received](int) { ++received; });
+        QBENCHMARK {
+            emit source.value(1);
+        }
+        subscription.unsubscribe();
+    }
+
+    void emit_fan_out_data()
+    {
+        QTest::addColumn<bool>("shared");
+        QTest::newRow("connection per subscriber") << false;
+        QTest::newRow("shared connection") << true;
+    }
+
+    // one emission delivered to 50 subscribers
+    void emit_fan_out()
+    {
+        QFETCH(bool, shared);
+        SignalSource source;
+        rxcpp::composite_subscription subscriptions;
+        int received = 0;
+        for (int i = 0; i != 50; ++i) {
+            auto values = shared
+                ? rxqt::from_signal_shared(&source, &SignalSource::value)
+                : rxqt::from_signal(&source, &SignalSource::value);
+            subscriptions.add(values.subscribe([&received](int) { ++received; }));
+        }
+        QBENCHMARK {
+            emit source.value(1);
+        }
+        subscriptions.unsubscribe();
+    }
+
+    void emit_large_payload_data()
+    {
+        QTest::addColumn<bool>("by_reference");
+        QTest::newRow("tuple copy") << false;
+        QTest::newRow("signal_args view") << true;
+    }
+
+    // a 100000 element vector per emission, read but not kept
+    void emit_large_payload()
+    {
+        QFETCH(bool, by_reference);
+        SignalSource source;
+        std::vector<double> samples(100000, 1.0);
+        double sum = 0;
+        rxcpp::composite_subscription subscription;
+        if (by_reference) {
+            subscription = rxqt::from_signal_ref(&source, &SignalSource::payload).subscribe([&sum](const rxqt::signal_args<const std::vector<double>&, int>& args) {
+                sum += args.get<0>().front();
+            });
+        } else {
+            subscription = rxqt::from_signal(&source, &SignalSource::payload).subscribe([&sum](const std::tuple<std::vector<double>, int>& args) {
+                sum += std::get<0>(args).front();
+            });
+        }
+        QBENCHMARK {
+            emit source.payload(samples, 1);
+        }
+        subscription.unsubscribe();
+    }
+
+    void cross_thread_signal_data()
+    {
+        QTest::addColumn<bool>("batched");
+        QTest::newRow("observe_on per emission") << false;
+        QTest::newRow("batched") << true;
+    }
+
+    // item_count emissions from another thread, delivered to this one
+    void cross_thread_signal()
+    {
+        QFETCH(bool, batched);
+        SignalSource source;
+        std::atomic<int> received(0);
+        rxcpp::composite_subscription subscription;
+        if (batched) {
+            subscription = rxqt::from_signal_batched(&source, &SignalSource::value, rxsc::make_qt_event_loop())
+                .subscribe([&received](const std::vector<int>& batch) { received += int(batch.size()); });
+        } else {
+            subscription = rxqt::from_signal(&source, &SignalSource::value)
+                .observe_on(rxcpp::observe_on_qt_event_loop())
+                .subscribe([&received](int) { ++received; });
+        }
+        QBENCHMARK {
+            received = 0;
+            QElapsedTimer timer;
+            timer.start();
+            std::thread producer([&source]() {
+                for (int i = 0; i != item_count; ++i) {
+                    emit source.value(i);
+                }
+            });
+            while (received.load() != item_count) {
+                QCoreApplication::processEvents();
+            }
+            producer.join();
+            qInfo() << "items/sec:" << qint64(item_count * 1e9 / timer.nsecsElapsed());
+        }
+        subscription.unsubscribe();
+    }
+
+    // another thread emits at 100k/s for a second, the consumer takes 1ms
+    // per value; reports how many values it saw and how long the last one
+    // took to arrive
+    void latest_under_stress()
+    {
+        SignalSource source;
+        std::atomic<int> last(-1);
+        int delivered = 0;
+        auto subscription = rxqt::from_signal_latest(&source, &SignalSource::value, rxsc::make_qt_event_loop())
+            .subscribe([&](int v) {
+                ++delivered;
+                last = v;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+        const int emissions = 100000;
+        std::chrono::steady_clock::time_point finished;
+        std::thread producer([&]() {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i != emissions; ++i) {
+                std::this_thread::sleep_until(start + std::chrono::microseconds(10 * i));
+                if (i == emissions - 1) {
+                    finished = std::chrono::steady_clock::now();
+                }
+                emit source.value(i);
+            }
+        });
+        while (last.load() != emissions - 1) {
+            QCoreApplication::processEvents();
+        }
+        auto lag = std::chrono::steady_clock::now() - finished;
+        producer.join();
+        qInfo() << "emitted:" << emissions << "delivered:" << delivered
+                << "last value after us:" << std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+        subscription.unsubscribe();
+    }
+
+    void emit_runtime_signal_data()
+    {
+        QTest::addColumn<bool>("runtime");
+        QTest::newRow("member pointer") << false;
+        QTest::newRow("QMetaMethod") << true;
+    }
+
+    void emit_runtime_signal()
+    {
+        QFETCH(bool, runtime);
+        SignalSource source;
+        int received = 0;
+        rxcpp::composite_subscription subscription;
+        if (runtime) {
+            subscription = rxqt::from_signal(&source, "value(int)").subscribe([&received](const QVariantList& args) { received += args.at(0).toInt(); });
+        } else {
+            subscription = rxqt::from_signal(&source, &SignalSource::value).subscribe([&received](int v) { received += v; });
+        }
+        QBENCHMARK {
+            emit source.value(1);
+        }
+        subscription.unsubscribe();
+    }
+
+    void property_updates_data()
+    {
+        QTest::addColumn<int>("kind");
+        QTest::newRow("from_signal, map, distinct") << 0;
+        QTest::newRow("from_property by name") << 1;
+        QTest::newRow("from_property typed") << 2;
+    }
+
+    // 20 subscribers to one property, every other update a duplicate
+    void property_updates()
+    {
+        QFETCH(int, kind);
+        SignalSource source;
+        rxcpp::composite_subscription subscriptions;
+        int received = 0;
+        for (int i = 0; i != 20; ++i) {
+            if (kind == 0) {
+                auto src = &source;
+                subscriptions.add(rxqt::from_signal(&source, &SignalSource::levelChanged)
+                    .map([src](long) { return src->property("level").toInt(); })
+                    .distinct_until_changed()
+                    .subscribe([&received](int) { ++received; }));
+            } else if (kind == 1) {
+                subscriptions.add(rxqt::from_property(&source, "level").subscribe([&received](const QVariant&) { ++received; }));
+            } else {
+                subscriptions.add(rxqt::from_property(&source, &SignalSource::level, &SignalSource::levelChanged).subscribe([&received](int) { ++received; }));
+            }
+        }
+        int level = 0;
+        QBENCHMARK {
+            source.setLevel(++level / 2);
+        }
+        subscriptions.unsubscribe();
+    }
+
+    void events_many_subscriptions_data()
+    {
+        QTest::addColumn<int>("kind");
+        QTest::addColumn<bool>("observed");
+        QTest::newRow("filter per subscription, unobserved event") << 0 << false;
+        QTest::newRow("filter per subscription, observed event") << 0 << true;
+        QTest::newRow("from_event, unobserved event") << 1 << false;
+        QTest::newRow("from_event, observed event") << 1 << true;
+    }
+
+    // 5 pipelines watching 10 event types each on one object
+    void events_many_subscriptions()
+    {
+        QFETCH(int, kind);
+        QFETCH(bool, observed);
+        QObject target;
+        rxcpp::composite_subscription subscriptions;
+        int received = 0;
+        for (int pipeline = 0; pipeline != 5; ++pipeline) {
+            for (int i = 0; i != 10; ++i) {
+                auto type = static_cast<QEvent::Type>(QEvent::User + i);
+                if (kind == 0) {
+                    target.installEventFilter(new legacy_event_filter(&target, type, [&received](QEvent*) { ++received; }));
+                } else {
+                    subscriptions.add(rxqt::from_event(&target, type).subscribe([&received](QEvent*) { ++received; }));
+                }
+            }
+        }
+        QEvent event(observed ? QEvent::User : QEvent::Paint);
+        QBENCHMARK {
+            QCoreApplication::sendEvent(&target, &event);
+        }
+        subscriptions.unsubscribe();
+    }
+
+    void application_events_data()
+    {
+        QTest::addColumn<int>("kind");
+        QTest::newRow("from_event per object") << 0;
+        QTest::newRow("from_application_event per object") << 1;
+    }
+
+    // 1000 objects, each watched for the mouse and key events; the cost of
+    // sending every object one event nobody waits for and one that is
+    // observed
+    void application_events()
+    {
+        QFETCH(int, kind);
+        std::vector<std::unique_ptr<QObject>> targets;
+        rxcpp::composite_subscription subscriptions;
+        int received = 0;
+        const std::vector<QEvent::Type> types{QEvent::MouseButtonPress, QEvent::MouseButtonRelease, QEvent::MouseMove, QEvent::KeyPress, QEvent::KeyRelease};
+        for (int i = 0; i != 1000; ++i) {
+            targets.emplace_back(new QObject);
+            auto observable = kind == 0 ? rxqt::from_event(targets.back().get(), types) : rxqt::from_application_event(targets.back().get(), types);
+            subscriptions.add(observable.subscribe([&received](QEvent*) { ++received; }));
+        }
+        QEvent unobserved(QEvent::Paint), observed(QEvent::KeyPress);
+        QBENCHMARK {
+            for (auto& target : targets) {
+                QCoreApplication::sendEvent(target.get(), &unobserved);
+                QCoreApplication::sendEvent(target.get(), &observed);
+            }
+        }
+        subscriptions.unsubscribe();
+    }
+
+    // 10000 delays up to a minute out, a tenth of them cancelled, run
+    // through the event loop on a virtual clock: scheduling overhead alone
+    void virtual_time_delays()
+    {
+        rxsc::qt_event_loop_options options;
+        options.clock = std::make_shared<rxsc::qt_virtual_clock>();
+        auto sc = rxsc::make_qt_event_loop(options);
+        QBENCHMARK {
+            rxcpp::composite_subscription cs;
+            auto w = sc.create_worker(cs);
+            std::vector<rxcpp::composite_subscription> timeouts(10000);
+            int ran = 0;
+            auto now = w.now();
+            for (int i = 0; i != 10000; ++i) {
+                auto when = now + std::chrono::milliseconds((i * 7919) % 60000 + 1);
+                w.schedule(when, rxsc::make_schedulable(w, timeouts[i], [&ran](const rxsc::schedulable&) { ++ran; }));
+            }
+            for (int i = 0; i < 10000; i += 10) {
+                timeouts[i].unsubscribe();
+            }
+            options.clock->advance_by(std::chrono::minutes(1));
+            QCOMPARE(ran, 9000);
+            cs.unsubscribe();
+        }
+    }
+
+    void delayed_jitter_timer_only()
+    {
+        run_jitter(rxsc::make_qt_event_loop(rxsc::qt_event_loop_options()));
+    }
+
+    void delayed_jitter_spin()
+    {
+        rxsc::qt_event_loop_options options;
+        options.spin_threshold = std::chrono::microseconds(1500);
+        run_jitter(rxsc::make_qt_event_loop(options));
+    }
+};
+
+QTEST_GUILESS_MAIN(BenchEventLoop)
+#include "eventloopbench.moc"
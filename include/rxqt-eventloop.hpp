@@ -5,133 +5,2604 @@
 #include <rxcpp/rx-includes.hpp>
 #include <QScopedPointer>
 #include <QTimer>
+#include <QCoreApplication>
+#include <QEvent>
 #include <QtDebug>
 #include <QLoggingCategory>
 #include <QTimerEvent>
 #include <QThread>
+#include <QPointer>
+#include <QAbstractEventDispatcher>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <thread>
+#include <stdexcept>
 
 Q_DECLARE_LOGGING_CATEGORY(rxqtEventLoop)
 
+// Debug output from the qt_event_loop internals. Compiled out of release
+// (QT_NO_DEBUG) builds unless RXQT_EVENTLOOP_DEBUG is defined, and out of
+// every build with RXQT_EVENTLOOP_NO_DEBUG. Use qt_event_loop_tracer to
+// look inside release builds.
+#if !defined(RXQT_EVENTLOOP_NO_DEBUG) && (defined(RXQT_EVENTLOOP_DEBUG) || !defined(QT_NO_DEBUG))
+#define RXQT_EVENTLOOP_LOG qCDebug(rxqtEventLoop)
+#else
+#define RXQT_EVENTLOOP_LOG while (false) QMessageLogger().noDebug()
+#endif
+
 namespace rxcpp {
 
-namespace schedulers {
+namespace schedulers {
+
+namespace detail {
+
+// Keeps up to 256 freed blocks per thread and type for reuse, so that a
+// thread scheduling onto its own event loop stops going to the heap once
+// warm. Only a block freed by the thread that allocated it is kept: a block
+// that crossed threads, like a node pushed by a producer and popped by the
+// loop, goes back to the heap rather than filling a pool whose thread
+// never allocates.
+template<class T>
+class qt_pool_allocator
+{
+public:
+    typedef T value_type;
+
+    qt_pool_allocator()
+    {
+    }
+
+    template<class U>
+    qt_pool_allocator(const qt_pool_allocator<U>&)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        auto& pool = local();
+        if (pool.head) {
+            auto block = pool.head;
+            pool.head = block->next;
+            --pool.count;
+            return reinterpret_cast<T*>(block);
+        }
+        auto h = static_cast<header*>(::operator new(sizeof(header) + sizeof(T)));
+        h->owner = &pool;
+        return reinterpret_cast<T*>(h + 1);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+        auto h = reinterpret_cast<header*>(p) - 1;
+        auto& pool = local();
+        if (h->owner == &pool && sizeof(T) >= sizeof(free_block) && !pool.closed && pool.count < capacity) {
+            auto block = reinterpret_cast<free_block*>(p);
+            block->next = pool.head;
+            pool.head = block;
+            ++pool.count;
+            return;
+        }
+        ::operator delete(h);
+    }
+
+    template<class U>
+    bool operator==(const qt_pool_allocator<U>&) const
+    {
+        return true;
+    }
+
+    template<class U>
+    bool operator!=(const qt_pool_allocator<U>&) const
+    {
+        return false;
+    }
+
+private:
+    enum { capacity = 256 };
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    // trivially destructible, so it stays usable after the thread's
+    // cleanup ran
+    struct free_list
+    {
+        free_block* head;
+        std::size_t count;
+        bool closed;
+    };
+
+    // in front of every single block, the pool of the allocating thread
+    union header
+    {
+        free_list* owner;
+        std::max_align_t align;
+    };
+
+    struct cleanup
+    {
+        explicit cleanup(free_list& pool)
+            : pool(pool)
+        {
+        }
+        ~cleanup()
+        {
+            pool.closed = true;
+            while (auto block = pool.head) {
+                pool.head = block->next;
+                ::operator delete(reinterpret_cast<header*>(block) - 1);
+            }
+            pool.count = 0;
+        }
+        free_list& pool;
+    };
+
+    static free_list& local()
+    {
+        static thread_local free_list pool = {nullptr, 0, false};
+        static thread_local cleanup on_exit(pool);
+        (void)on_exit;
+        return pool;
+    }
+};
+
+// Intrusive multi-producer/single-consumer FIFO (after D. Vyukov). push() is
+// wait-free and may be called from any thread, pop() and empty() only from
+// the single consuming thread.
+template<class T>
+class qt_ready_queue
+{
+public:
+    struct node
+    {
+        node()
+            : next(nullptr)
+        {
+        }
+
+        explicit node(T v)
+            : next(nullptr)
+            , value(std::move(v))
+        {
+        }
+
+        std::atomic<node*> next;
+        rxcpp::util::maybe<T> value;
+    };
+
+    qt_ready_queue()
+        : head(&stub)
+        , tail(&stub)
+    {
+    }
+
+    ~qt_ready_queue()
+    {
+        while (node* n = pop()) {
+            destroy(n);
+        }
+    }
+
+    // Nodes come from a qt_pool_allocator.
+    static node* make(T v)
+    {
+        qt_pool_allocator<node> alloc;
+        node* n = alloc.allocate(1);
+        try {
+            ::new (static_cast<void*>(n)) node(std::move(v));
+        } catch (...) {
+            alloc.deallocate(n, 1);
+            throw;
+        }
+        return n;
+    }
+
+    static void destroy(node* n)
+    {
+        n->~node();
+        qt_pool_allocator<node>().deallocate(n, 1);
+    }
+
+    struct node_deleter
+    {
+        void operator()(node* n) const
+        {
+            destroy(n);
+        }
+    };
+    typedef std::unique_ptr<node, node_deleter> node_ptr;
+
+    void push(node* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Returns nullptr when the queue is empty, and also while the most
+    // recent producer has not finished linking its node. That producer
+    // wakes the consumer up after push() returns, so nothing is lost.
+    node* pop()
+    {
+        node* t = tail;
+        node* next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (!next) {
+                return nullptr;
+            }
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+    bool empty() const
+    {
+        return tail == &stub && !stub.next.load(std::memory_order_acquire);
+    }
+
+private:
+    qt_ready_queue(const qt_ready_queue&);
+
+    std::atomic<node*> head;
+    node* tail;
+    node stub;
+};
+
+// A scheduled item. The id is only assigned while a tracer is attached,
+// when only while stats are.
+struct qt_queued_item
+{
+    typedef scheduler_base::clock_type clock_type;
+
+    qt_queued_item(schedulable what, std::uint64_t id, clock_type::time_point when = clock_type::time_point())
+        : what(std::move(what))
+        , id(id)
+        , when(when)
+    {
+    }
+
+    schedulable what;
+    std::uint64_t id;
+    // when the item asked to run
+    clock_type::time_point when;
+};
+
+// An item with a future deadline. Shared with the cancellation hook the
+// worker registers on the item's subscription.
+struct qt_timed_entry
+{
+    typedef scheduler_base::clock_type clock_type;
+
+    qt_timed_entry(clock_type::time_point when, schedulable what, std::uint64_t id)
+        : when(when)
+        , ordinal(0)
+        , id(id)
+        , what(std::move(what))
+        , cancelled(false)
+        , queue(nullptr)
+        , level(-1)
+        , slot(0)
+    {
+    }
+
+    clock_type::time_point when;
+    std::uint64_t ordinal;
+    std::uint64_t id;
+    // released as soon as the entry runs or is cancelled
+    rxcpp::util::maybe<schedulable> what;
+    composite_subscription::weak_subscription hook;
+    bool cancelled;
+    // the queue holding the entry, if any
+    const void* queue;
+
+    // position inside a qt_timer_wheel, level -1 when not linked
+    int level;
+    int slot;
+    std::list<std::shared_ptr<qt_timed_entry>>::iterator pos;
+};
+
+// Storage for items with a future deadline. Not thread-safe, the worker
+// guards it with its lock.
+class qt_timed_queue
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+    typedef std::shared_ptr<qt_timed_entry> entry_ptr;
+
+    virtual ~qt_timed_queue()
+    {
+    }
+
+    virtual void push(const entry_ptr& e) = 0;
+
+    // Called once the worker has released the cancelled item's schedulable.
+    virtual void cancel(const entry_ptr& e) = 0;
+
+    // Moves the subscribed items due at now into out, in deadline order.
+    virtual void take_due(clock_type::time_point now, std::vector<qt_queued_item>& out) = 0;
+
+    // The earliest time take_due() may find something, false when empty.
+    virtual bool next_deadline(clock_type::time_point& when) const = 0;
+
+    // entries waiting for their deadline
+    virtual std::size_t live() const = 0;
+    // cancelled entries still taking up room
+    virtual std::size_t dead() const = 0;
+
+protected:
+    static bool earlier(const entry_ptr& lhs, const entry_ptr& rhs)
+    {
+        return lhs->when < rhs->when || (lhs->when == rhs->when && lhs->ordinal < rhs->ordinal);
+    }
+
+    static void take(const entry_ptr& e, std::vector<qt_queued_item>& out)
+    {
+        e->queue = nullptr;
+        if (e->what.empty()) {
+            return;
+        }
+        if (!e->hook.expired()) {
+            e->what.get().get_subscription().remove(e->hook);
+        }
+        if (e->what.get().is_subscribed()) {
+            out.push_back(qt_queued_item(std::move(e->what.get()), e->id, e->when));
+        }
+        e->what.reset();
+    }
+};
+
+// Binary heap ordered by deadline, then by insertion. Cancelled entries
+// become tombstones that are popped off the top right away and compacted
+// out once they outnumber the live ones.
+class qt_timed_heap : public qt_timed_queue
+{
+public:
+    qt_timed_heap()
+        : ordinal(0)
+        , tombstones(0)
+    {
+    }
+
+    virtual void push(const entry_ptr& e) {
+        e->ordinal = ordinal++;
+        e->queue = this;
+        heap.push_back(e);
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    virtual void cancel(const entry_ptr&) {
+        ++tombstones;
+        if (tombstones > compact_threshold && tombstones * 2 > heap.size()) {
+            compact();
+        }
+        pop_tombstones();
+    }
+
+    virtual void take_due(clock_type::time_point now, std::vector<qt_queued_item>& out) {
+        while (!heap.empty() && heap.front()->when <= now) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            take(heap.back(), out);
+            heap.pop_back();
+            pop_tombstones();
+        }
+    }
+
+    virtual bool next_deadline(clock_type::time_point& when) const {
+        if (heap.empty()) {
+            return false;
+        }
+        when = heap.front()->when;
+        return true;
+    }
+
+    virtual bool empty() const {
+        return heap.empty();
+    }
+
+    virtual std::size_t live() const {
+        return heap.size() - tombstones;
+    }
+
+    virtual std::size_t dead() const {
+        return tombstones;
+    }
+
+private:
+    enum { compact_threshold = 64 };
+
+    static bool later(const entry_ptr& lhs, const entry_ptr& rhs)
+    {
+        return earlier(rhs, lhs);
+    }
+
+    // keeps the head live, so next_deadline() never reports a dead item
+    void pop_tombstones()
+    {
+        while (!heap.empty() && heap.front()->cancelled) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            heap.pop_back();
+            --tombstones;
+        }
+    }
+
+    void compact()
+    {
+        heap.erase(std::remove_if(heap.begin(), heap.end(), [](const entry_ptr& e) { return e->cancelled; }), heap.end());
+        std::make_heap(heap.begin(), heap.end(), later);
+        tombstones = 0;
+    }
+
+    std::vector<entry_ptr> heap;
+    std::uint64_t ordinal;
+    std::size_t tombstones;
+};
+
+// Hierarchical timer wheel with millisecond ticks: four levels of 64 slots
+// cover about 4.6 hours, anything further out waits in an overflow list.
+// Insertion and cancellation are O(1), entries cascade to finer levels as
+// their slot comes up and expire bucket by bucket.
+class qt_timer_wheel : public qt_timed_queue
+{
+public:
+    explicit qt_timer_wheel(clock_type::time_point origin = clock_type::now())
+        : origin(origin)
+        , current(0)
+        , ordinal(0)
+        , count(0)
+    {
+        std::fill(std::begin(occupied), std::end(occupied), 0);
+    }
+
+    virtual void push(const entry_ptr& e) {
+        e->ordinal = ordinal++;
+        e->queue = this;
+        place(e, current);
+        ++count;
+    }
+
+    virtual void cancel(const entry_ptr& e) {
+        if (e->level >= 0) {
+            unlink(e);
+            --count;
+        }
+    }
+
+    virtual void take_due(clock_type::time_point now, std::vector<qt_queued_item>& out) {
+        std::vector<entry_ptr> batch(expired.begin(), expired.end());
+        for (auto& e : batch) {
+            unlink(e);
+        }
+        advance(elapsed_ticks(now), batch);
+        count -= batch.size();
+        // one bucket spans a whole millisecond
+        std::sort(batch.begin(), batch.end(), earlier);
+        for (auto& e : batch) {
+            take(e, out);
+        }
+    }
+
+    virtual bool next_deadline(clock_type::time_point& when) const {
+        if (!expired.empty()) {
+            when = origin + std::chrono::milliseconds(current);
+            return true;
+        }
+        std::uint64_t tick = 0;
+        bool found = false;
+        if (occupied[0] != 0) {
+            // level 0 holds the next 63 ticks, one tick per slot
+            tick = current + 1;
+            while (!(occupied[0] & (std::uint64_t(1) << (tick & slot_mask)))) {
+                ++tick;
+            }
+            found = true;
+        }
+        // the next cascade of the first populated level may come first, an
+        // entry there can be due before anything in level 0
+        int l = 1;
+        while (l != levels && occupied[l] == 0) {
+            ++l;
+        }
+        if (l != levels || !overflow.empty()) {
+            auto cascade = (current / span(l) + 1) * span(l);
+            if (!found || cascade < tick) {
+                tick = cascade;
+            }
+            found = true;
+        }
+        if (!found) {
+            return false;
+        }
+        when = origin + std::chrono::milliseconds(tick);
+        return true;
+    }
+
+    virtual bool empty() const {
+        return count == 0;
+    }
+
+    virtual std::size_t live() const {
+        return count;
+    }
+
+    virtual std::size_t dead() const {
+        return 0;
+    }
+
+private:
+    typedef std::list<entry_ptr> bucket;
+
+    enum {
+        bits = 6,
+        slot_count = 1 << bits,
+        slot_mask = slot_count - 1,
+        levels = 4,
+        overflow_level = levels,
+        expired_level = levels + 1
+    };
+
+    static std::uint64_t span(int level)
+    {
+        return std::uint64_t(1) << (bits * level);
+    }
+
+    // ticks that have fully elapsed
+    std::uint64_t elapsed_ticks(clock_type::time_point now) const
+    {
+        if (now <= origin) {
+            return 0;
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now - origin).count();
+    }
+
+    // the first tick at or after when
+    std::uint64_t deadline_tick(clock_type::time_point when) const
+    {
+        if (when <= origin) {
+            return 0;
+        }
+        auto d = when - origin;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(d);
+        return ms.count() + (ms < d ? 1 : 0);
+    }
+
+    bucket& bucket_of(int level, int slot)
+    {
+        if (level == expired_level) {
+            return expired;
+        }
+        if (level == overflow_level) {
+            return overflow;
+        }
+        return wheel[level][slot];
+    }
+
+    void link(const entry_ptr& e, int level, int slot)
+    {
+        auto& b = bucket_of(level, slot);
+        e->level = level;
+        e->slot = slot;
+        e->pos = b.insert(b.end(), e);
+        if (level < levels) {
+            occupied[level] |= std::uint64_t(1) << slot;
+        }
+    }
+
+    void unlink(const entry_ptr& e)
+    {
+        auto& b = bucket_of(e->level, e->slot);
+        if (e->level < levels && b.size() == 1) {
+            occupied[e->level] &= ~(std::uint64_t(1) << e->slot);
+        }
+        e->level = -1;
+        b.erase(e->pos);
+    }
+
+    // Files e relative to tick now, in the finest level whose range covers
+    // its distance. Slots are indexed by absolute tick bits, so an entry
+    // reaches level 0 exactly when its level's slot is cascaded.
+    void place(const entry_ptr& e, std::uint64_t now)
+    {
+        auto tick = deadline_tick(e->when);
+        if (tick <= now) {
+            link(e, expired_level, 0);
+            return;
+        }
+        auto delta = tick - now;
+        for (int l = 0; l != levels; ++l) {
+            if (delta < span(l + 1)) {
+                link(e, l, static_cast<int>((tick >> (bits * l)) & slot_mask));
+                return;
+            }
+        }
+        link(e, overflow_level, 0);
+    }
+
+    void cascade(bucket& b, std::uint64_t now, std::vector<entry_ptr>& due)
+    {
+        bucket moving;
+        moving.swap(b);
+        for (auto& e : moving) {
+            e->level = -1;
+            place(e, now);
+            if (e->level == expired_level) {
+                unlink(e);
+                due.push_back(e);
+            }
+        }
+    }
+
+    void advance(std::uint64_t target, std::vector<entry_ptr>& due)
+    {
+        while (current < target) {
+            // skip ticks on which nothing can expire or cascade
+            int l = 0;
+            while (l != levels && occupied[l] == 0) {
+                ++l;
+            }
+            if (l == levels && overflow.empty()) {
+                current = target;
+                break;
+            }
+            auto next = l == 0 ? current + 1 : (current / span(l) + 1) * span(l);
+            if (next > target) {
+                current = target;
+                break;
+            }
+            current = next;
+
+            if (current % span(levels) == 0) {
+                cascade(overflow, current, due);
+            }
+            for (int level = levels - 1; level > 0; --level) {
+                if (current % span(level) == 0) {
+                    int slot = static_cast<int>((current >> (bits * level)) & slot_mask);
+                    occupied[level] &= ~(std::uint64_t(1) << slot);
+                    cascade(wheel[level][slot], current, due);
+                }
+            }
+            int slot = static_cast<int>(current & slot_mask);
+            auto& b = wheel[0][slot];
+            for (auto& e : b) {
+                e->level = -1;
+                due.push_back(e);
+            }
+            b.clear();
+            occupied[0] &= ~(std::uint64_t(1) << slot);
+        }
+    }
+
+    clock_type::time_point origin;
+    // the last tick that has been expired
+    std::uint64_t current;
+    std::uint64_t ordinal;
+    std::size_t count;
+    bucket wheel[levels][slot_count];
+    std::uint64_t occupied[levels];
+    bucket overflow;
+    // entries whose deadline tick had already passed when they were filed
+    bucket expired;
+};
+
+// Rounds up, so that a timer never fires before the deadline and an item
+// due in under a millisecond does not get a 0 ms timer.
+inline std::chrono::milliseconds qt_ceil_milliseconds(scheduler_base::clock_type::duration d)
+{
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(d);
+    return ms < d ? ms + std::chrono::milliseconds(1) : ms;
+}
+
+// Deleter for worker states, which own timers and connections: released on
+// another thread, the state is deleted later on its own.
+inline void qt_delete_on_own_thread(QObject* o)
+{
+    if (o->thread() && o->thread() != QThread::currentThread()) {
+        o->deleteLater();
+    } else {
+        delete o;
+    }
+}
+
+// The frame clock of a qt_frame_loop, shared by all its workers. Work
+// pushed from any thread is collected and run in one batch at the next
+// frame boundary, on the thread the clock lives in. The timer only runs
+// while something is waiting, and stops with the application, so a clock
+// kept in a static does not hold a timer past it.
+class qt_frame_clock : public QObject, public std::enable_shared_from_this<qt_frame_clock>
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+
+    qt_frame_clock(clock_type::duration interval, QThread* thread)
+        : interval(interval)
+        , origin(clock_type::now())
+        , arm_pending(false)
+    {
+        moveToThread(thread);
+        if (auto app = QCoreApplication::instance()) {
+            connect(app, &QCoreApplication::aboutToQuit, this, [this]() {
+                stop();
+            });
+        }
+    }
+
+    void push(const schedulable& what)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        pending.push_back(what);
+        request_frame(clock_type::now(), guard);
+    }
+
+    void push(clock_type::time_point when, const schedulable& what)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        timed.push(std::allocate_shared<qt_timed_entry>(qt_pool_allocator<qt_timed_entry>(), when, what, 0));
+        request_frame(when, guard);
+    }
+
+private:
+    // Asks the clock's thread to arm the timer. Holds a strong reference
+    // so the clock outlives it.
+    struct arm_event : public QEvent
+    {
+        explicit arm_event(std::shared_ptr<qt_frame_clock> c)
+            : QEvent(type())
+            , keepAlive(std::move(c))
+        {
+        }
+
+        static QEvent::Type type()
+        {
+            static const QEvent::Type t = static_cast<QEvent::Type>(QEvent::registerEventType());
+            return t;
+        }
+
+        std::shared_ptr<qt_frame_clock> keepAlive;
+    };
+
+    bool event(QEvent* e)
+    {
+        if (e->type() == arm_event::type()) {
+            arm();
+            return true;
+        }
+        return QObject::event(e);
+    }
+
+    void timerEvent(QTimerEvent *)
+    {
+        std::vector<schedulable> batch;
+        std::vector<qt_queued_item> due;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            kill_timer();
+            batch.swap(pending);
+            timed.take_due(clock_type::now(), due);
+        }
+        // work scheduled by the batch waits for the next frame
+        r.reset(false);
+        for (auto& item : due) {
+            run(item.what);
+        }
+        for (auto& what : batch) {
+            run(what);
+        }
+        arm();
+    }
+
+    void run(const schedulable& what)
+    {
+        if (what.is_subscribed()) {
+            what(r.get_recurse());
+        }
+    }
+
+    // Kills the timer and drops whatever is waiting.
+    void stop()
+    {
+        std::vector<schedulable> dropped;
+        std::vector<qt_queued_item> dropped_timed;
+        std::unique_lock<std::mutex> guard(lock);
+        kill_timer();
+        dropped.swap(pending);
+        timed.take_due(clock_type::time_point::max(), dropped_timed);
+        guard.unlock();
+    }
+
+    // Called under the lock. Posts to the clock's thread unless the timer
+    // already fires in time or a request is on its way.
+    void request_frame(clock_type::time_point when, std::unique_lock<std::mutex>& guard)
+    {
+        if (arm_pending || (!armed_for.empty() && armed_for.get() <= boundary(when))) {
+            return;
+        }
+        arm_pending = true;
+        guard.unlock();
+        QCoreApplication::postEvent(this, new arm_event(shared_from_this()));
+    }
+
+    // Points the timer at the frame boundary where the earliest waiting
+    // work is due.
+    void arm()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        arm_pending = false;
+        auto now = clock_type::now();
+        auto when = now;
+        if (pending.empty() && !timed.next_deadline(when)) {
+            kill_timer();
+            return;
+        }
+        auto next = boundary(std::max(when, now));
+        if (!armed_for.empty() && armed_for.get() == next) {
+            return;
+        }
+        kill_timer();
+        current_timer.reset(startTimer(qt_ceil_milliseconds(next - now).count(), Qt::PreciseTimer));
+        armed_for.reset(next);
+    }
+
+    // The first frame boundary at or after t.
+    clock_type::time_point boundary(clock_type::time_point t) const
+    {
+        auto frames = (t - origin + interval - clock_type::duration(1)) / interval;
+        return origin + frames * interval;
+    }
+
+    void kill_timer()
+    {
+        if (!current_timer.empty()) {
+            killTimer(current_timer.get());
+            current_timer.reset();
+            armed_for.reset();
+        }
+    }
+
+    const clock_type::duration interval;
+    const clock_type::time_point origin;
+    // guards everything but r
+    std::mutex lock;
+    std::vector<schedulable> pending;
+    qt_timed_heap timed;
+    bool arm_pending;
+    rxcpp::util::maybe<int> current_timer;
+    rxcpp::util::maybe<clock_type::time_point> armed_for;
+    recursion r;
+};
+
+}
+
+// Log-linear histogram of durations in microseconds, in the manner of
+// HdrHistogram: eight buckets per power of two, so any recorded value is
+// reported within 12.5%. Recording is lock-free.
+class qt_latency_histogram
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+
+    qt_latency_histogram()
+        : total(0)
+        , highest(0)
+    {
+        for (auto& c : counts) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(clock_type::duration d)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        auto value = us > 0 ? std::uint64_t(us) : 0;
+        counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        auto seen = highest.load(std::memory_order_relaxed);
+        while (value > seen && !highest.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::uint64_t count() const
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::microseconds max() const
+    {
+        return std::chrono::microseconds(highest.load(std::memory_order_relaxed));
+    }
+
+    // The smallest value at least percentile percent of the recorded
+    // values do not exceed, rounded up to its bucket. 0 when empty.
+    std::chrono::microseconds value_at_percentile(double percentile) const
+    {
+        std::uint64_t seen = 0;
+        for (int i = 0; i != bucket_count; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+        }
+        if (seen == 0) {
+            return std::chrono::microseconds(0);
+        }
+        auto wanted = std::uint64_t(std::ceil(seen * std::min(percentile, 100.0) / 100.0));
+        wanted = std::max<std::uint64_t>(wanted, 1);
+        std::uint64_t sum = 0;
+        for (int i = 0; i != bucket_count; ++i) {
+            sum += counts[i].load(std::memory_order_relaxed);
+            if (sum >= wanted) {
+                return std::chrono::microseconds(std::min(highest_in(i), highest.load(std::memory_order_relaxed)));
+            }
+        }
+        return max();
+    }
+
+private:
+    enum { sub_bits = 3, sub_count = 1 << sub_bits, bucket_count = (64 - sub_bits + 1) * sub_count };
+
+    static int msb(std::uint64_t value)
+    {
+        int bit = 0;
+        while (value >>= 1) {
+            ++bit;
+        }
+        return bit;
+    }
+
+    // values below 8 get a bucket each, then eight per power of two
+    static int index_of(std::uint64_t value)
+    {
+        if (value < sub_count) {
+            return int(value);
+        }
+        int shift = msb(value) - sub_bits;
+        return (shift + 1) * sub_count + int(value >> shift) - sub_count;
+    }
+
+    static std::uint64_t highest_in(int index)
+    {
+        if (index < sub_count) {
+            return std::uint64_t(index);
+        }
+        int shift = index / sub_count - 1;
+        std::uint64_t sub = std::uint64_t(index % sub_count + sub_count);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::atomic<std::uint64_t> counts[bucket_count];
+    std::atomic<std::uint64_t> total;
+    std::atomic<std::uint64_t> highest;
+};
+
+// A point-in-time copy of qt_event_loop_stats, for reporting.
+struct qt_event_loop_metrics
+{
+    std::int64_t queue_depth;
+    std::int64_t peak_queue_depth;
+    std::uint64_t executed;
+    std::chrono::microseconds longest_action;
+    std::chrono::microseconds latency_p50;
+    std::chrono::microseconds latency_p99;
+    std::chrono::microseconds latency_p999;
+    std::chrono::microseconds latency_max;
+};
+
+// Counters shared by all workers of a qt_event_loop scheduler, not kept
+// per worker: a worker measured on its own gets a scheduler of its own.
+// The default make_qt_event_loop() scheduler keeps none.
+struct qt_event_loop_stats
+{
+    qt_event_loop_stats()
+        : drains(0)
+        , item_budget_hits(0)
+        , time_budget_hits(0)
+        , timed_live(0)
+        , timed_dead(0)
+        , queue_depth(0)
+        , peak_queue_depth(0)
+        , executed(0)
+        , longest_action(0)
+    {
+    }
+
+    qt_event_loop_metrics metrics() const
+    {
+        qt_event_loop_metrics m;
+        m.queue_depth = queue_depth.load();
+        m.peak_queue_depth = peak_queue_depth.load();
+        m.executed = executed.load();
+        m.longest_action = std::chrono::microseconds(longest_action.load());
+        m.latency_p50 = latency.value_at_percentile(50);
+        m.latency_p99 = latency.value_at_percentile(99);
+        m.latency_p999 = latency.value_at_percentile(99.9);
+        m.latency_max = latency.max();
+        return m;
+    }
+
+    // handle_queue() passes started
+    std::atomic<std::uint64_t> drains;
+    // passes that yielded after max_items_per_drain items
+    std::atomic<std::uint64_t> item_budget_hits;
+    // passes that yielded after max_drain_time
+    std::atomic<std::uint64_t> time_budget_hits;
+    // timed items waiting for their deadline
+    std::atomic<std::int64_t> timed_live;
+    // cancelled timed items the heap has not compacted away yet
+    std::atomic<std::int64_t> timed_dead;
+    // items ready to run and waiting for their worker
+    std::atomic<std::int64_t> queue_depth;
+    std::atomic<std::int64_t> peak_queue_depth;
+    // actions run
+    std::atomic<std::uint64_t> executed;
+    // the longest single action, in microseconds
+    std::atomic<std::int64_t> longest_action;
+    // from when an item asked to run to when it started
+    qt_latency_histogram latency;
+};
+
+// Lock-free ring of the most recent worker events, for finding out after
+// the fact why the loop stalled. Any thread may record, old records are
+// overwritten. A record torn by a concurrent overwrite is left out of
+// snapshot().
+class qt_event_loop_tracer
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+
+    enum event_kind
+    {
+        scheduled,
+        scheduled_timed,
+        cancelled,
+        wakeup_posted,
+        drain_begin,
+        drain_end,
+        budget_exhausted,
+        run_begin,
+        run_end,
+        run_inline,
+        timer_armed,
+        timer_fired,
+        timer_killed
+    };
+
+    struct record
+    {
+        // clock_type ticks since its epoch
+        std::int64_t timestamp;
+        event_kind kind;
+        const void* worker;
+        std::uint64_t item;
+    };
+
+    // capacity is rounded up to a power of two
+    explicit qt_event_loop_tracer(std::size_t capacity = 4096)
+        : mask(round_up(capacity) - 1)
+        , ring(new slot[mask + 1])
+        , next(0)
+        , ids(0)
+    {
+    }
+
+    void trace(event_kind kind, const void* worker, std::uint64_t item = 0)
+    {
+        auto index = next.fetch_add(1, std::memory_order_relaxed);
+        auto& s = ring[index & mask];
+        s.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.timestamp.store(clock_type::now().time_since_epoch().count(), std::memory_order_relaxed);
+        s.kind.store(kind, std::memory_order_relaxed);
+        s.worker.store(worker, std::memory_order_relaxed);
+        s.item.store(item, std::memory_order_relaxed);
+        s.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    // A fresh non-zero id for a scheduled item.
+    std::uint64_t next_id()
+    {
+        return ++ids;
+    }
+
+    // The records still in the ring, oldest first.
+    std::vector<record> snapshot() const
+    {
+        std::vector<record> result;
+        auto end = next.load(std::memory_order_acquire);
+        auto begin = end > mask + 1 ? end - (mask + 1) : 0;
+        result.reserve(end - begin);
+        for (auto index = begin; index != end; ++index) {
+            auto& s = ring[index & mask];
+            auto sequence = s.sequence.load(std::memory_order_acquire);
+            record r;
+            r.timestamp = s.timestamp.load(std::memory_order_relaxed);
+            r.kind = s.kind.load(std::memory_order_relaxed);
+            r.worker = s.worker.load(std::memory_order_relaxed);
+            r.item = s.item.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence == index + 1 && s.sequence.load(std::memory_order_relaxed) == sequence) {
+                result.push_back(r);
+            }
+        }
+        return result;
+    }
+
+    static const char* name(event_kind kind)
+    {
+        static const char* const names[] = {
+            "scheduled", "scheduled_timed", "cancelled", "wakeup_posted",
+            "drain_begin", "drain_end", "budget_exhausted", "run_begin",
+            "run_end", "run_inline", "timer_armed", "timer_fired", "timer_killed"
+        };
+        return names[kind];
+    }
+
+    // Writes the snapshot to out, one record per line.
+    void dump(QDebug out) const
+    {
+        for (auto& r : snapshot()) {
+            out.nospace() << r.timestamp << ' ' << name(r.kind) << ' ' << r.worker << ' ' << r.item << '\n';
+        }
+    }
+
+private:
+    struct slot
+    {
+        slot()
+            : sequence(0)
+            , timestamp(0)
+            , kind(scheduled)
+            , worker(nullptr)
+            , item(0)
+        {
+        }
+
+        // index + 1 of the record held, 0 while it is written
+        std::atomic<std::uint64_t> sequence;
+        std::atomic<std::int64_t> timestamp;
+        std::atomic<event_kind> kind;
+        std::atomic<const void*> worker;
+        std::atomic<std::uint64_t> item;
+    };
+
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    const std::uint64_t mask;
+    std::unique_ptr<slot[]> ring;
+    std::atomic<std::uint64_t> next;
+    std::atomic<std::uint64_t> ids;
+};
+
+// An action that ran for at least the watchdog's threshold.
+struct qt_event_loop_stall
+{
+    // qt_event_loop_options::label of the scheduler that ran it
+    QString label;
+    std::chrono::microseconds duration;
+    const void* worker;
+    // the tracer's id for the item, 0 without a tracer
+    std::uint64_t item;
+};
+
+// Times every action of the schedulers it is attached to and reports the
+// ones that block their thread for threshold or longer. Reports arrive on
+// the thread of the offending worker, right after the action returns,
+// unless another report is being delivered right then: that delivery
+// passes it on once the subscriber returns, on its own thread.
+class qt_event_loop_watchdog
+{
+public:
+    explicit qt_event_loop_watchdog(std::chrono::microseconds threshold = std::chrono::milliseconds(50))
+        : limit(threshold)
+        , reporter(offenders.get_subscriber())
+        , delivering(false)
+    {
+    }
+
+    std::chrono::microseconds threshold() const
+    {
+        return limit;
+    }
+
+    rxcpp::observable<qt_event_loop_stall> stalls() const
+    {
+        return offenders.get_observable();
+    }
+
+    // Reports go out one at a time, without holding the lock across the
+    // subscriber, which may pump events and report again.
+    void report(qt_event_loop_stall stall)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        queue.push_back(std::move(stall));
+        if (delivering) {
+            return;
+        }
+        delivering = true;
+        while (!queue.empty()) {
+            auto next = std::move(queue.front());
+            queue.pop_front();
+            guard.unlock();
+            reporter.on_next(std::move(next));
+            guard.lock();
+        }
+        delivering = false;
+    }
+
+private:
+    const std::chrono::microseconds limit;
+    rxcpp::subjects::subject<qt_event_loop_stall> offenders;
+    rxcpp::subscriber<qt_event_loop_stall> reporter;
+    std::mutex lock;
+    std::deque<qt_event_loop_stall> queue;
+    bool delivering;
+};
+
+// A manually advanced clock for qt_event_loop schedulers, attached through
+// qt_event_loop_options::clock. Their workers read the time from it and,
+// instead of arming Qt timers, wait for the clock to reach their
+// deadlines. Items still run from posted events on the real Qt event loop,
+// which advance_to() and advance_by() drive. Advancing waits only for the
+// workers of the calling thread; workers on other threads are woken and
+// left to their own event loops.
+class qt_virtual_clock
+{
+public:
+    typedef scheduler_base::clock_type clock_type;
+
+    // What the clock needs from a worker.
+    class client
+    {
+    public:
+        virtual ~client()
+        {
+        }
+        virtual bool next_deadline(clock_type::time_point& when) const = 0;
+        // posts the worker a drain of whatever came due
+        virtual void wake() = 0;
+        // a posted drain has not run yet
+        virtual bool pending() const = 0;
+        // the worker runs on the calling thread
+        virtual bool local() const = 0;
+    };
+
+    explicit qt_virtual_clock(clock_type::time_point start = clock_type::now())
+        : current(start.time_since_epoch().count())
+    {
+    }
+
+    clock_type::time_point now() const
+    {
+        return clock_type::time_point(clock_type::duration(current.load()));
+    }
+
+    void attach(std::weak_ptr<client> c)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const std::weak_ptr<client>& w) {
+            return w.expired();
+        }), clients.end());
+        clients.push_back(std::move(c));
+    }
+
+    // Steps through the deadlines up to when, earliest first, letting the
+    // event loop run what each one brings due before stepping on. Work
+    // scheduled meanwhile is picked up if it falls before when.
+    void advance_to(clock_type::time_point when)
+    {
+        settle();
+        forever {
+            clock_type::time_point next;
+            if (!earliest(next) || next > when) {
+                break;
+            }
+            set(next);
+            wake_all();
+            settle();
+        }
+        set(when);
+        wake_all();
+        settle();
+    }
+
+    void advance_by(clock_type::duration d)
+    {
+        advance_to(now() + d);
+    }
+
+private:
+    std::vector<std::shared_ptr<client>> live() const
+    {
+        std::vector<std::shared_ptr<client>> result;
+        std::unique_lock<std::mutex> guard(lock);
+        for (auto& w : clients) {
+            if (auto c = w.lock()) {
+                result.push_back(std::move(c));
+            }
+        }
+        return result;
+    }
+
+    bool earliest(clock_type::time_point& next) const
+    {
+        bool found = false;
+        for (auto& c : live()) {
+            clock_type::time_point when;
+            if (c->next_deadline(when) && (!found || when < next)) {
+                next = when;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void wake_all()
+    {
+        for (auto& c : live()) {
+            c->wake();
+        }
+    }
+
+    // Processes events until no worker of this thread has a drain
+    // outstanding. Drains posted during a round, like those of workers out
+    // of budget, run in the next one. Other threads' drains are not this
+    // thread's events to process, waiting for them could spin forever.
+    void settle()
+    {
+        do {
+            QCoreApplication::processEvents();
+        } while (any_pending());
+    }
+
+    bool any_pending() const
+    {
+        for (auto& c : live()) {
+            if (c->local() && c->pending()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // time never runs backwards
+    void set(clock_type::time_point t)
+    {
+        auto ticks = t.time_since_epoch().count();
+        auto seen = current.load();
+        while (ticks > seen && !current.compare_exchange_weak(seen, ticks)) {
+        }
+    }
+
+    std::atomic<clock_type::rep> current;
+    mutable std::mutex lock;
+    std::vector<std::weak_ptr<client>> clients;
+};
+
+// How a qt_event_loop worker stores items scheduled for a future time.
+enum class qt_timer_storage
+{
+    // binary heap, O(log n) insertion, cancelled items are compacted away
+    heap,
+    // hierarchical timer wheel with 1 ms buckets, O(1) insertion and
+    // cancellation, for many concurrent delays and timeouts
+    wheel
+};
+
+// Which lane a qt_event_loop scheduler's work travels in. Wakeups are
+// posted with the matching Qt event priority, so pending interactive work
+// drains before normal work, and normal before background. Background
+// workers also yield after background_items_per_drain items unless
+// max_items_per_drain says otherwise, so their share of the thread stays
+// bounded.
+enum class qt_event_loop_priority
+{
+    interactive,
+    normal,
+    background
+};
+
+struct qt_event_loop_options
+{
+    enum { background_items_per_drain = 32 };
+
+    qt_event_loop_options()
+        : max_items_per_drain(0)
+        , max_drain_time(0)
+        , spin_threshold(0)
+        , timer_storage(qt_timer_storage::heap)
+        , inline_when_idle(false)
+        , priority(qt_event_loop_priority::normal)
+    {
+    }
+
+    // Items run by one pass before the worker yields back to the Qt event
+    // loop and posts itself a new wakeup, 0 for no limit.
+    int max_items_per_drain;
+    // Time one pass may take before yielding the same way, 0 for no limit.
+    std::chrono::microseconds max_drain_time;
+    // Deadlines closer than this are waited for by spinning instead of
+    // arming a Qt timer, for sub-millisecond accuracy. Timers are armed
+    // this much early. 0 disables spinning.
+    std::chrono::microseconds spin_threshold;
+    qt_timer_storage timer_storage;
+    // The thread whose event loop runs the workers' items. Unset, each
+    // worker runs on the thread that created it.
+    QPointer<QThread> thread;
+    // Run an immediate item right inside schedule() when that is called on
+    // the worker's thread while the worker is idle, instead of queueing
+    // it for the next event loop round-trip. Meant for observe_on: under a
+    // serialize_ coordination the inline action would take the
+    // serialization lock, which the scheduling code may already hold.
+    bool inline_when_idle;
+    // Updated by all of the scheduler's workers together when set.
+    std::shared_ptr<qt_event_loop_stats> stats;
+    // Receives the workers' events when set.
+    std::shared_ptr<qt_event_loop_tracer> tracer;
+    // Reports the workers' long actions when set.
+    std::shared_ptr<qt_event_loop_watchdog> watchdog;
+    // Names the scheduler in watchdog reports.
+    QString label;
+    qt_event_loop_priority priority;
+    // Replaces the system clock and the Qt timers when set.
+    std::shared_ptr<qt_virtual_clock> clock;
+
+    int items_per_drain() const
+    {
+        if (max_items_per_drain == 0 && priority == qt_event_loop_priority::background) {
+            return background_items_per_drain;
+        }
+        return max_items_per_drain;
+    }
+
+    int event_priority() const
+    {
+        switch (priority) {
+        case qt_event_loop_priority::interactive:
+            return Qt::HighEventPriority;
+        case qt_event_loop_priority::background:
+            return Qt::LowEventPriority;
+        default:
+            return Qt::NormalEventPriority;
+        }
+    }
+};
+
+struct qt_event_loop : public scheduler_interface
+{
+private:
+    typedef qt_event_loop this_type;
+    qt_event_loop(const this_type&);
+
+    struct qtimer_worker : public worker_interface
+    {
+    private:
+        typedef qtimer_worker this_type;
+        typedef detail::action_queue queue_type;
+
+        qtimer_worker(const this_type&);
+
+        class qtimer_worker_state : public QObject, public qt_virtual_clock::client, public std::enable_shared_from_this<qtimer_worker_state>
+        {
+        public:
+            typedef detail::qt_timed_queue timed_queue;
+            typedef timed_queue::entry_ptr entry_ptr;
+
+            typedef detail::qt_queued_item queued_item;
+            typedef detail::qt_ready_queue<queued_item> ready_queue;
+            typedef ready_queue::node ready_node;
+
+            // Posted to the state object to drain the queue. Holds a strong
+            // reference so the state outlives every pending wakeup.
+            struct wakeup_event : public QEvent
+            {
+                explicit wakeup_event(std::shared_ptr<qtimer_worker_state> s)
+                    : QEvent(type())
+                    , keepAlive(std::move(s))
+                {
+                }
+
+                static QEvent::Type type()
+                {
+                    static const QEvent::Type t = static_cast<QEvent::Type>(QEvent::registerEventType());
+                    return t;
+                }
+
+                std::shared_ptr<qtimer_worker_state> keepAlive;
+            };
+
+            virtual ~qtimer_worker_state()
+            {
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), : deallocating, timer";
+                std::unique_lock<std::mutex> guard(lock);
+                kill_timer();
+                lifetime.unsubscribe();
+                if (options.stats) {
+                    std::int64_t left = std::int64_t(due.size() - due_next);
+                    while (auto n = ready.pop()) {
+                        ready_queue::destroy(n);
+                        ++left;
+                    }
+                    options.stats->queue_depth -= left;
+                }
+                RXQT_EVENTLOOP_LOG << this << ": deallocating done, timer";
+            }
+
+            qtimer_worker_state(composite_subscription cs, const qt_event_loop_options& o)
+                : lifetime(cs)
+                , options(o)
+                , timed(make_timed_queue(o.timer_storage, current_time()))
+                , published_live(0)
+                , published_dead(0)
+                , due_next(0)
+                , running(false)
+                , wakeup_pending(false)
+            {
+            }
+
+            // True once nothing is left to run or armed, on the state's own
+            // thread, so the state can serve another worker.
+            bool recyclable() const
+            {
+                return thread() == QThread::currentThread()
+                    && current_timer.empty()
+                    && !running
+                    && !wakeup_pending.load()
+                    && ready.empty()
+                    && due_next == due.size()
+                    && timed->live() == 0
+                    && timed->dead() == 0;
+            }
+
+            void reuse(composite_subscription cs)
+            {
+                lifetime = cs;
+                due.clear();
+                due_next = 0;
+                r.reset(false);
+            }
+
+            bool event(QEvent * e)
+            {
+                if (e->type() == wakeup_event::type()) {
+                    // clear before draining, so that anything pushed after the
+                    // drain has looked at the queue posts a fresh wakeup
+                    wakeup_pending.store(false);
+                    handle_queue();
+                    return true;
+                }
+                return QObject::event(e);
+            }
+
+            // Posts at most one wakeup at a time, schedules that arrive before
+            // it is delivered are drained by the same handle_queue() pass.
+            void wakeup()
+            {
+                if (!wakeup_pending.exchange(true)) {
+                    trace(qt_event_loop_tracer::wakeup_posted);
+                    QCoreApplication::postEvent(this, new wakeup_event(shared_from_this()), options.event_priority());
+                }
+            }
+
+            void timerEvent(QTimerEvent * event)
+            {
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), : timer event from timer" << event->timerId();
+                trace(qt_event_loop_tracer::timer_fired);
+                {
+                    // Qt timers repeat, this one has to be re-armed for the next deadline
+                    std::unique_lock<std::mutex> guard(lock);
+                    armed_for.reset();
+                }
+                handle_queue();
+            }
+
+            void handle_queue()
+            {
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), : handle_queue()";
+                running_scope scope(running);
+                trace(qt_event_loop_tracer::drain_begin);
+                if (options.stats) {
+                    ++options.stats->drains;
+                }
+                auto started = clock_type::now();
+                int count = 0;
+                forever {
+                    // timed items that came due were scheduled before anything
+                    // now waiting in the ready queue, so they run first. A pass
+                    // that yielded resumes with the due items it left behind.
+                    bool timed_idle = false;
+                    if (due_next == due.size()) {
+                        due.clear();
+                        due_next = 0;
+                        timed_idle = take_due_items();
+                    }
+                    bool ran = false;
+                    while (due_next != due.size()) {
+                        auto what = std::move(due[due_next++]);
+                        dequeued();
+                        run_item(what, timed_idle && due_next == due.size() && ready.empty());
+                        ran = true;
+                        if (yield_if_exhausted(++count, started)) {
+                            return;
+                        }
+                    }
+
+                    while (auto n = ready.pop()) {
+                        ready_queue::node_ptr owner(n);
+                        dequeued();
+                        run_item(n->value.get(), timed_idle && ready.empty());
+                        ran = true;
+                        if (yield_if_exhausted(++count, started)) {
+                            return;
+                        }
+                    }
+
+                    if (!ran && arm_timer()) {
+                        break;
+                    }
+                }
+                trace(qt_event_loop_tracer::drain_end);
+            }
+
+            // True on the worker's thread when nothing is running, queued or
+            // due ahead, so running an immediate item now keeps the order.
+            // The other fields belong to that thread, so it is checked first.
+            bool can_run_inline() const
+            {
+                if (thread() != QThread::currentThread()) {
+                    return false;
+                }
+                if (running || due_next != due.size() || !ready.empty()) {
+                    return false;
+                }
+                std::unique_lock<std::mutex> guard(lock);
+                clock_type::time_point when;
+                return !timed->next_deadline(when) || current_time() < when;
+            }
+
+            // Recursion is allowed as in run_item(), so an action
+            // rescheduling itself loops inside the schedulable instead of
+            // growing the stack. Anything scheduled meanwhile sees the worker
+            // running and gets queued.
+            void run_inline(const schedulable& what)
+            {
+                running_scope scope(running);
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), running item inline";
+                auto id = item_id();
+                trace(qt_event_loop_tracer::run_inline, id);
+                r.reset(true);
+                if (!ready.empty()) {
+                    r.reset(false);
+                }
+                timed_run(what, current_time(), id);
+                trace(qt_event_loop_tracer::run_end, id);
+            }
+
+            // Ends the pass once its budget is spent. The fresh wakeup lands
+            // behind whatever the Qt event loop has queued meanwhile.
+            bool yield_if_exhausted(int count, clock_type::time_point started)
+            {
+                auto limit = options.items_per_drain();
+                bool items = limit > 0 && count >= limit;
+                bool time = !items && options.max_drain_time.count() > 0 && clock_type::now() - started >= options.max_drain_time;
+                if (!items && !time) {
+                    return false;
+                }
+                if (options.stats) {
+                    ++(items ? options.stats->item_budget_hits : options.stats->time_budget_hits);
+                }
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), drain budget exhausted after" << count << "items";
+                trace(qt_event_loop_tracer::budget_exhausted);
+                wakeup();
+                return true;
+            }
+
+            static std::unique_ptr<timed_queue> make_timed_queue(qt_timer_storage storage, clock_type::time_point now)
+            {
+                if (storage == qt_timer_storage::wheel) {
+                    return std::unique_ptr<timed_queue>(new detail::qt_timer_wheel(now));
+                }
+                return std::unique_ptr<timed_queue>(new detail::qt_timed_heap());
+            }
+
+            // The virtual clock's time when there is one.
+            clock_type::time_point current_time() const
+            {
+                return options.clock ? options.clock->now() : clock_type::now();
+            }
+
+            bool next_deadline(clock_type::time_point& when) const
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                return timed->next_deadline(when);
+            }
+
+            void wake()
+            {
+                wakeup();
+            }
+
+            bool pending() const
+            {
+                return wakeup_pending.load();
+            }
+
+            bool local() const
+            {
+                return thread() == QThread::currentThread();
+            }
+
+            // Moves every subscribed item that is due from the timed queue
+            // into due, returns true when nothing else there is due.
+            bool take_due_items()
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                auto now = current_time();
+                auto before = due.size();
+                timed->take_due(now, due);
+                publish_gauges();
+                enqueued(due.size() - before);
+                clock_type::time_point next;
+                return !timed->next_deadline(next) || now < next;
+            }
+
+            // Returns false when the next deadline came due meanwhile and
+            // the queue has to be drained again instead.
+            bool arm_timer()
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                clock_type::time_point when;
+                if (!timed->next_deadline(when)) {
+                    kill_timer();
+                    return true;
+                }
+                auto now = current_time();
+                if (now >= when) {
+                    return false;
+                }
+                if (options.clock) {
+                    // the clock wakes the worker when it gets there
+                    return true;
+                }
+                if (when - now <= options.spin_threshold) {
+                    guard.unlock();
+                    spin_until(when);
+                    return false;
+                }
+                if (!armed_for.empty() && armed_for.get() == when) {
+                    return true;
+                }
+                schedule_timer(when, detail::qt_ceil_milliseconds(when - now - options.spin_threshold));
+                return true;
+            }
+
+            // Called from the cancellation hook, on whichever thread
+            // unsubscribed the item.
+            void cancel(const entry_ptr& e)
+            {
+                rxcpp::util::maybe<schedulable> dead;
+                std::unique_lock<std::mutex> guard(lock);
+                e->cancelled = true;
+                if (e->what.empty()) {
+                    return;
+                }
+                trace(qt_event_loop_tracer::cancelled, e->id);
+                // the captured state is released outside the lock
+                dead.reset(std::move(e->what.get()));
+                e->what.reset();
+                // entries cleared out with the worker's lifetime belong to
+                // a queue that is gone
+                if (e->queue == timed.get()) {
+                    timed->cancel(e);
+                    publish_gauges();
+                }
+                guard.unlock();
+            }
+
+            // Moves the scheduler-wide gauges by what changed in this
+            // worker's timed queue since the last call, under the lock.
+            void publish_gauges()
+            {
+                if (!options.stats) {
+                    return;
+                }
+                auto live = timed->live();
+                auto dead = timed->dead();
+                options.stats->timed_live += std::int64_t(live) - std::int64_t(published_live);
+                options.stats->timed_dead += std::int64_t(dead) - std::int64_t(published_dead);
+                published_live = live;
+                published_dead = dead;
+            }
+
+            // Final approach to a deadline closer than the timer resolution,
+            // cut short when immediate work shows up.
+            void spin_until(clock_type::time_point when)
+            {
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), spinning";
+                while (clock_type::now() < when && ready.empty()) {
+                    std::this_thread::yield();
+                }
+            }
+
+            // Recursion is only allowed while nothing else waits, so an item
+            // rescheduling itself cannot overtake work queued before it ran;
+            // work queued while it recurses runs once it stops. r belongs to
+            // this thread, producers never touch it. The queue is looked at
+            // again after allowing recursion, so that a push racing with the
+            // decision is not skipped.
+            void run_item(const queued_item& item, bool allow_recursion)
+            {
+                if (!item.what.is_subscribed()) {
+                    RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), is not subscribed, continuing";
+                    return;
+                }
+                r.reset(allow_recursion);
+                if (allow_recursion && !ready.empty()) {
+                    r.reset(false);
+                }
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), running item";
+                trace(qt_event_loop_tracer::run_begin, item.id);
+                timed_run(item.what, item.when, item.id);
+                trace(qt_event_loop_tracer::run_end, item.id);
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), running item complete";
+            }
+
+            // Runs what and, with stats or a watchdog attached, records how
+            // late it started and how long it took.
+            void timed_run(const schedulable& what, clock_type::time_point when, std::uint64_t id)
+            {
+                if (!options.stats && !options.watchdog) {
+                    what(r.get_recurse());
+                    return;
+                }
+                auto started = clock_type::now();
+                if (options.stats) {
+                    options.stats->latency.record(current_time() - when);
+                }
+                what(r.get_recurse());
+                auto took = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - started);
+                if (options.stats) {
+                    ++options.stats->executed;
+                    store_max(options.stats->longest_action, took.count());
+                }
+                if (options.watchdog && took >= options.watchdog->threshold()) {
+                    RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), action of" << options.label << "took" << took.count() << "us";
+                    qt_event_loop_stall stall;
+                    stall.label = options.label;
+                    stall.duration = took;
+                    stall.worker = this;
+                    stall.item = id;
+                    options.watchdog->report(std::move(stall));
+                }
+            }
+
+            // Stamp for an immediate item, only taken when stats want it.
+            clock_type::time_point stamp() const
+            {
+                return options.stats ? current_time() : clock_type::time_point();
+            }
+
+            void enqueued(std::size_t count = 1)
+            {
+                if (options.stats && count) {
+                    auto depth = options.stats->queue_depth += std::int64_t(count);
+                    store_max(options.stats->peak_queue_depth, depth);
+                }
+            }
+
+            void dequeued()
+            {
+                if (options.stats) {
+                    --options.stats->queue_depth;
+                }
+            }
+
+            static void store_max(std::atomic<std::int64_t>& target, std::int64_t value)
+            {
+                auto seen = target.load(std::memory_order_relaxed);
+                while (value > seen && !target.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+                }
+            }
+
+            void trace(qt_event_loop_tracer::event_kind kind, std::uint64_t item = 0) const
+            {
+                if (options.tracer) {
+                    options.tracer->trace(kind, this, item);
+                }
+            }
+
+            // 0 unless a tracer wants to follow items
+            std::uint64_t item_id() const
+            {
+                return options.tracer ? options.tracer->next_id() : 0;
+            }
+
+            // Timers belong to the worker's thread. Called elsewhere, the
+            // timer is left to fire once more and find the queue empty.
+            void kill_timer() {
+                if (!current_timer.empty() && thread() == QThread::currentThread()) {
+                    RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), killing timer" << current_timer.get();
+                    killTimer(current_timer.get());
+                    trace(qt_event_loop_tracer::timer_killed);
+                    current_timer.reset();
+                    armed_for.reset();
+                }
+            }
+
+            void schedule_timer(clock_type::time_point when, std::chrono::milliseconds timeout) {
+                kill_timer();
+                current_timer.reset(startTimer(timeout.count(), Qt::PreciseTimer));
+                armed_for.reset(when);
+                trace(qt_event_loop_tracer::timer_armed);
+                RXQT_EVENTLOOP_LOG << this << ": thread(" << QThread::currentThreadId() << "), started timer" << current_timer.get();
+            }
+
+            // Marks the worker busy on its own thread, nests for reentrant
+            // event processing.
+            struct running_scope
+            {
+                explicit running_scope(bool& flag)
+                    : flag(flag)
+                    , previous(flag)
+                {
+                    flag = true;
+                }
+                ~running_scope()
+                {
+                    flag = previous;
+                }
+                bool& flag;
+                bool previous;
+            };
+
+            composite_subscription lifetime;
+            const qt_event_loop_options options;
+            // guards the timed queue and the timer, the ready queue is lock-free
+            mutable std::mutex lock;
+            std::unique_ptr<timed_queue> timed;
+            std::size_t published_live;
+            std::size_t published_dead;
+            ready_queue ready;
+            std::vector<queued_item> due;
+            std::size_t due_next;
+            // only touched on the worker's thread
+            bool running;
+            rxcpp::util::maybe<int> current_timer;
+            rxcpp::util::maybe<clock_type::time_point> armed_for;
+            recursion r;
+            std::atomic<bool> wakeup_pending;
+        };
+
+        std::shared_ptr<qtimer_worker_state> state;
+
+    public:
+        // Worker states whose lifetime ended, kept by the scheduler for its
+        // next workers on the same thread. States that still have work or a
+        // timer, or that are released on another thread, are deleted, on
+        // their own thread, where their timer can be killed; so are those
+        // still pooled when the scheduler goes.
+        class state_pool
+        {
+        public:
+            enum { capacity = 16 };
+
+            ~state_pool()
+            {
+                for (auto s : idle) {
+                    detail::qt_delete_on_own_thread(s);
+                }
+            }
+
+            // pinned says options.thread was set when the scheduler was made.
+            // Should that thread be gone, the worker starts out finished
+            // rather than running its items on the wrong thread.
+            static std::shared_ptr<qtimer_worker_state> acquire(const std::shared_ptr<state_pool>& pool, composite_subscription cs, const qt_event_loop_options& options, bool pinned)
+            {
+                QThread* target = options.thread.data();
+                if (!target) {
+                    if (pinned) {
+                        qWarning("rxqt: the thread of a qt_event_loop scheduler is gone, its new worker is unsubscribed");
+                        cs.unsubscribe();
+                    }
+                    target = QThread::currentThread();
+                }
+                qtimer_worker_state* s = pool->take(target);
+                if (s) {
+                    s->reuse(cs);
+                } else {
+                    s = new qtimer_worker_state(cs, options);
+                    if (options.thread) {
+                        s->moveToThread(options.thread);
+                    }
+                }
+                std::weak_ptr<state_pool> weakPool = pool;
+                return std::shared_ptr<qtimer_worker_state>(s, [weakPool](qtimer_worker_state* s) {
+                    auto pool = weakPool.lock();
+                    if (pool && pool->give(s)) {
+                        return;
+                    }
+                    detail::qt_delete_on_own_thread(s);
+                });
+            }
+
+        private:
+            qtimer_worker_state* take(QThread* target)
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                for (auto it = idle.begin(); it != idle.end(); ++it) {
+                    if ((*it)->thread() == target) {
+                        auto s = *it;
+                        idle.erase(it);
+                        return s;
+                    }
+                }
+                return nullptr;
+            }
+
+            bool give(qtimer_worker_state* s)
+            {
+                if (!s->recyclable()) {
+                    return false;
+                }
+                // the worker's lifetime is over, whatever still hangs off
+                // it is released now
+                s->lifetime.unsubscribe();
+                std::unique_lock<std::mutex> guard(lock);
+                if (idle.size() >= capacity) {
+                    return false;
+                }
+                idle.push_back(s);
+                return true;
+            }
 
-struct qt_event_loop : public scheduler_interface
+            std::mutex lock;
+            std::vector<qtimer_worker_state*> idle;
+        };
+
+        virtual ~qtimer_worker()
+        {
+        }
+
+        qtimer_worker(composite_subscription cs, const qt_event_loop_options& options, const std::shared_ptr<state_pool>& pool, bool pinned)
+            : state(state_pool::acquire(pool, cs, options, pinned))
+        {
+
+            auto keepAlive = state;
+
+            state->lifetime.add([keepAlive](){
+                std::unique_lock<std::mutex> guard(keepAlive->lock);
+                auto expired = qtimer_worker_state::make_timed_queue(keepAlive->options.timer_storage, keepAlive->current_time());
+                expired.swap(keepAlive->timed);
+                keepAlive->publish_gauges();
+                keepAlive->kill_timer();
+                guard.unlock();
+            });
+
+            if (state->options.clock) {
+                state->options.clock->attach(state);
+            }
+        }
+
+        virtual clock_type::time_point now() const {
+            return state->current_time();
+        }
+
+        virtual void schedule(const schedulable& scbl) const {
+            if (!scbl.is_subscribed() || !state->lifetime.is_subscribed()) {
+                return;
+            }
+            if (state->options.inline_when_idle && state->can_run_inline()) {
+                state->run_inline(scbl);
+                return;
+            }
+            auto id = state->item_id();
+            state->trace(qt_event_loop_tracer::scheduled, id);
+            state->enqueued();
+            state->ready.push(qtimer_worker_state::ready_queue::make(qtimer_worker_state::queued_item(scbl, id, state->stamp())));
+            state->wakeup();
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            if (when <= now()) {
+                schedule(scbl);
+                return;
+            }
+
+            auto e = std::allocate_shared<detail::qt_timed_entry>(detail::qt_pool_allocator<detail::qt_timed_entry>(), when, scbl, state->item_id());
+            // registered before the entry is filed, a hook that fires right
+            // away only marks it cancelled
+            std::weak_ptr<qtimer_worker_state> weakState = state;
+            std::weak_ptr<detail::qt_timed_entry> weakEntry = e;
+            e->hook = scbl.get_subscription().add([weakState, weakEntry]() {
+                auto s = weakState.lock();
+                auto entry = weakEntry.lock();
+                if (s && entry) {
+                    s->cancel(entry);
+                }
+            });
+
+            std::unique_lock<std::mutex> guard(state->lock);
+            if (e->cancelled || !scbl.is_subscribed() || !state->lifetime.is_subscribed()) {
+                return;
+            }
+            state->timed->push(e);
+            state->publish_gauges();
+            state->trace(qt_event_loop_tracer::scheduled_timed, e->id);
+            guard.unlock();
+
+            state->wakeup();
+        }
+    };
+
+    qt_event_loop_options options;
+    // options.thread was set, so the workers must not fall back to the
+    // calling thread once it is gone
+    bool pinned;
+    std::shared_ptr<qtimer_worker::state_pool> pool;
+
+public:
+    explicit qt_event_loop(qt_event_loop_options o = qt_event_loop_options())
+        : options(std::move(o))
+        , pinned(!options.thread.isNull())
+        , pool(std::make_shared<qtimer_worker::state_pool>())
+    {
+    }
+
+    virtual ~qt_event_loop()
+    {
+    }
+
+    virtual clock_type::time_point now() const {
+        return options.clock ? options.clock->now() : clock_type::now();
+    }
+
+    virtual worker create_worker(composite_subscription cs) const {
+        return worker(cs, std::allocate_shared<qtimer_worker>(detail::qt_pool_allocator<qtimer_worker>(), cs, options, pool, pinned));
+    }
+};
+
+inline scheduler make_qt_event_loop() {
+    static scheduler instance = make_scheduler<qt_event_loop>();
+    return instance;
+}
+
+// A separate scheduler, tuned by the given options.
+inline scheduler make_qt_event_loop(qt_event_loop_options options) {
+    return make_scheduler<qt_event_loop>(std::move(options));
+}
+
+// The shared scheduler, with inline_when_idle set.
+inline scheduler make_qt_event_loop_inline() {
+    static scheduler instance = make_qt_event_loop([]() {
+        qt_event_loop_options options;
+        options.inline_when_idle = true;
+        return options;
+    }());
+    return instance;
+}
+
+// A scheduler running everything on the event loop of thread.
+inline scheduler make_qt_event_loop(QThread* thread) {
+    qt_event_loop_options options;
+    options.thread = thread;
+    return make_qt_event_loop(std::move(options));
+}
+
+// A scheduler running everything on the thread context lives in when this
+// is called.
+inline scheduler make_qt_event_loop(const QObject* context) {
+    return make_qt_event_loop(context->thread());
+}
+
+// The shared scheduler of a priority lane.
+inline scheduler make_qt_event_loop(qt_event_loop_priority priority) {
+    auto lane = [](qt_event_loop_priority p) {
+        qt_event_loop_options options;
+        options.priority = p;
+        return make_qt_event_loop(std::move(options));
+    };
+    static scheduler interactive = lane(qt_event_loop_priority::interactive);
+    static scheduler background = lane(qt_event_loop_priority::background);
+    switch (priority) {
+    case qt_event_loop_priority::interactive:
+        return interactive;
+    case qt_event_loop_priority::background:
+        return background;
+    default:
+        return make_qt_event_loop();
+    }
+}
+
+// Runs work only while the event loop of the worker's thread has nothing
+// else to do. Items are drained from the dispatcher's aboutToBlock()
+// notification, one slice at a time, and the dispatcher is woken up again
+// while work remains. Some dispatchers (the glib one) announce every wait
+// whether or not events are pending, so a slice is skipped while the
+// dispatcher reports pending events. That check needs Qt 5, whose
+// hasPendingEvents() may still miss events another thread is posting
+// right then; Qt 6 has no such call, and a slice waits one more turn of
+// the loop instead. Cancelled timed items and, once the worker is
+// unsubscribed, all of its items are dropped right away. The worker's
+// thread needs an event dispatcher.
+struct qt_idle_loop : public scheduler_interface
 {
 private:
-    typedef qt_event_loop this_type;
-    qt_event_loop(const this_type&);
+    typedef qt_idle_loop this_type;
+    qt_idle_loop(const this_type&);
 
-    struct qtimer_worker : public worker_interface
+    struct idle_worker : public worker_interface
     {
     private:
-        typedef qtimer_worker this_type;
-        typedef detail::action_queue queue_type;
-
-        qtimer_worker(const this_type&);
+        typedef idle_worker this_type;
+        idle_worker(const this_type&);
 
-        class qtimer_worker_state : public QObject, public std::enable_shared_from_this<qtimer_worker_state>
+        class idle_worker_state : public QObject, public std::enable_shared_from_this<idle_worker_state>
         {
         public:
-            typedef detail::schedulable_queue<
-                typename clock_type::time_point> queue_item_time;
+            typedef detail::qt_queued_item queued_item;
+            typedef detail::qt_ready_queue<queued_item> ready_queue;
+            typedef ready_queue::node ready_node;
+            typedef detail::qt_timed_queue::entry_ptr entry_ptr;
 
-            typedef queue_item_time::item_type item_type;
+            idle_worker_state(composite_subscription cs, std::chrono::microseconds slice)
+                : lifetime(cs)
+                , slice(slice)
+                , dispatcher(QAbstractEventDispatcher::instance())
+                , timed(new detail::qt_timed_heap())
+                , due_next(0)
+                , running(false)
+                , deferred(false)
+            {
+            }
 
-            virtual ~qtimer_worker_state()
+            virtual ~idle_worker_state()
             {
-                qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), : deallocating, timer";
                 std::unique_lock<std::mutex> guard(lock);
                 kill_timer();
                 lifetime.unsubscribe();
-                qCDebug(rxqtEventLoop) << this << ": deallocating done, timer";
             }
 
-            explicit qtimer_worker_state(composite_subscription cs)
-                : lifetime(cs)
+            void attach()
             {
+                std::weak_ptr<idle_worker_state> weak = shared_from_this();
+                if (dispatcher) {
+                    connect(dispatcher, &QAbstractEventDispatcher::aboutToBlock, this, [weak]() {
+                        if (auto s = weak.lock()) {
+                            s->run_slice();
+                        }
+                    }, Qt::DirectConnection);
+                }
+                // the queues hold schedulables that hold the worker, they
+                // are let go of as soon as the worker ends
+                lifetime.add([weak]() {
+                    if (auto s = weak.lock()) {
+                        if (s->thread() == QThread::currentThread() && !s->running) {
+                            s->clear();
+                        } else {
+                            s->wakeup();
+                        }
+                    }
+                });
             }
 
-            void timerEvent(QTimerEvent * event)
+            // Called from the cancellation hook, on whichever thread
+            // unsubscribed the item.
+            void cancel(const entry_ptr& e)
             {
-                qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), : timer event from timer" << event->timerId();
-                handle_queue();
+                rxcpp::util::maybe<schedulable> dead;
+                std::unique_lock<std::mutex> guard(lock);
+                e->cancelled = true;
+                if (e->what.empty()) {
+                    return;
+                }
+                // the captured state is released outside the lock
+                dead.reset(std::move(e->what.get()));
+                e->what.reset();
+                if (e->queue == timed.get()) {
+                    timed->cancel(e);
+                }
+                guard.unlock();
             }
 
-            void handle_queue()
+            // Drops every item, on the worker's thread.
+            void clear()
             {
-                qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), : handle_queue()";
-                forever {
+                std::unique_ptr<detail::qt_timed_queue> expired(new detail::qt_timed_heap());
+                std::vector<queued_item> dropped;
+                dropped.swap(due);
+                due_next = 0;
+                while (auto n = ready.pop()) {
+                    ready_queue::node_ptr owner(n);
+                }
+                std::unique_lock<std::mutex> guard(lock);
+                expired.swap(timed);
+                kill_timer();
+                guard.unlock();
+            }
+
+            void wakeup()
+            {
+                if (dispatcher) {
+                    dispatcher->wakeUp();
+                }
+            }
+
+            // The timer only has to wake the loop, the next aboutToBlock()
+            // takes the due items.
+            void timerEvent(QTimerEvent *)
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                kill_timer();
+            }
+
+            // Runs at least one item, then more until the slice is used up.
+            void run_slice()
+            {
+                if (running) {
+                    // a nested event loop inside one of our items
+                    return;
+                }
+                if (!lifetime.is_subscribed()) {
+                    clear();
+                    return;
+                }
+                if (due_next == due.size()) {
+                    due.clear();
+                    due_next = 0;
                     std::unique_lock<std::mutex> guard(lock);
-                    if (q.empty()) {
-                        kill_timer();
+                    timed->take_due(clock_type::now(), due);
+                }
+                if (due_next == due.size() && ready.empty()) {
+                    arm_timer();
+                    return;
+                }
+                if (events_pending()) {
+                    // not idle after all, try again once they are handled
+                    wakeup();
+                    return;
+                }
+                running_scope scope(running);
+                auto started = clock_type::now();
+                do {
+                    if (due_next != due.size()) {
+                        auto item = std::move(due[due_next++]);
+                        run_item(item);
+                    } else if (auto n = ready.pop()) {
+                        ready_queue::node_ptr owner(n);
+                        run_item(n->value.get());
+                    } else {
                         break;
                     }
+                } while (clock_type::now() - started < slice && lifetime.is_subscribed());
 
-                    auto& peek = q.top();
-                    if (!peek.what.is_subscribed()) {
-                        qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), is not subscribed, continuing";
-                        q.pop();
-                        continue;
-                    }
+                if (!lifetime.is_subscribed()) {
+                    clear();
+                    return;
+                }
+                if (due_next != due.size() || !ready.empty()) {
+                    wakeup();
+                    return;
+                }
+                arm_timer();
+            }
 
-                    auto now = clock_type::now();
-                    if (now >= peek.when) {
-                        auto what = peek.what;
-                        q.pop();
-                        r.reset(q.empty());
-                        qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), running item";
-                        guard.unlock();
-                        what(r.get_recurse());
-                        qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), running item complete";
-                        continue;
-                    }
+            void run_item(const queued_item& item)
+            {
+                if (item.what.is_subscribed()) {
+                    r.reset(false);
+                    item.what(r.get_recurse());
+                }
+            }
 
-                    auto d = std::chrono::duration_cast<std::chrono::milliseconds>(peek.when - now);
-                    schedule_timer(d);
-                    break;
+            bool events_pending()
+            {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+                return dispatcher->hasPendingEvents();
+#else
+                // no way to ask, every other turn of the loop is let by
+                deferred = !deferred;
+                return deferred;
+#endif
+            }
+
+            void arm_timer()
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                clock_type::time_point when;
+                if (!timed->next_deadline(when)) {
+                    kill_timer();
+                    return;
+                }
+                if (!armed_for.empty() && armed_for.get() == when) {
+                    return;
                 }
+                auto now = clock_type::now();
+                if (now >= when) {
+                    guard.unlock();
+                    wakeup();
+                    return;
+                }
+                kill_timer();
+                current_timer.reset(startTimer(detail::qt_ceil_milliseconds(when - now).count(), Qt::PreciseTimer));
+                armed_for.reset(when);
             }
 
-            void kill_timer() {
-                if (!current_timer.empty()) {
-                    qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), killing timer" << current_timer.get();
+            void kill_timer()
+            {
+                if (!current_timer.empty() && thread() == QThread::currentThread()) {
                     killTimer(current_timer.get());
+                    current_timer.reset();
+                    armed_for.reset();
                 }
             }
 
-            void schedule_timer(std::chrono::milliseconds timeout) {
-                kill_timer();
-                current_timer.reset(startTimer(timeout.count(), Qt::PreciseTimer));
-                qCDebug(rxqtEventLoop) << this << ": thread(" << QThread::currentThreadId() << "), started timer" << current_timer.get();
-            }
+            struct running_scope
+            {
+                explicit running_scope(bool& flag)
+                    : flag(flag)
+                {
+                    flag = true;
+                }
+                ~running_scope()
+                {
+                    flag = false;
+                }
+                bool& flag;
+            };
 
             composite_subscription lifetime;
-            mutable std::mutex lock;
-            mutable queue_item_time q;
+            const std::chrono::microseconds slice;
+            QPointer<QAbstractEventDispatcher> dispatcher;
+            // guards the timed queue and the timer, the ready queue is lock-free
+            std::mutex lock;
+            std::unique_ptr<detail::qt_timed_queue> timed;
+            ready_queue ready;
+            std::vector<queued_item> due;
+            std::size_t due_next;
+            // only touched on the worker's thread
+            bool running;
+            bool deferred;
             rxcpp::util::maybe<int> current_timer;
+            rxcpp::util::maybe<clock_type::time_point> armed_for;
             recursion r;
         };
 
-        std::shared_ptr<qtimer_worker_state> state;
+        std::shared_ptr<idle_worker_state> state;
 
     public:
-        virtual ~qtimer_worker()
+        idle_worker(composite_subscription cs, std::chrono::microseconds slice)
+            : state(new idle_worker_state(cs, slice), detail::qt_delete_on_own_thread)
         {
+            state->attach();
         }
 
-        qtimer_worker(composite_subscription cs)
-            : state(std::make_shared<qtimer_worker_state>(cs))
+        virtual ~idle_worker()
         {
+        }
 
-            auto keepAlive = state;
+        virtual clock_type::time_point now() const {
+            return clock_type::now();
+        }
 
-            state->lifetime.add([keepAlive](){
-                std::unique_lock<std::mutex> guard(keepAlive->lock);
-                auto expired = std::move(keepAlive->q);
-                if (!keepAlive->q.empty()) std::terminate();
-                keepAlive->kill_timer();
+        virtual void schedule(const schedulable& scbl) const {
+            if (!scbl.is_subscribed() || !state->lifetime.is_subscribed()) {
+                return;
+            }
+            state->ready.push(idle_worker_state::ready_queue::make(idle_worker_state::queued_item(scbl, 0)));
+            state->wakeup();
+        }
+
+        virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
+            if (when <= now()) {
+                schedule(scbl);
+                return;
+            }
+
+            auto e = std::allocate_shared<detail::qt_timed_entry>(detail::qt_pool_allocator<detail::qt_timed_entry>(), when, scbl, 0);
+            std::weak_ptr<idle_worker_state> weakState = state;
+            std::weak_ptr<detail::qt_timed_entry> weakEntry = e;
+            e->hook = scbl.get_subscription().add([weakState, weakEntry]() {
+                auto s = weakState.lock();
+                auto entry = weakEntry.lock();
+                if (s && entry) {
+                    s->cancel(entry);
+                }
             });
+
+            std::unique_lock<std::mutex> guard(state->lock);
+            if (e->cancelled || !scbl.is_subscribed() || !state->lifetime.is_subscribed()) {
+                return;
+            }
+            state->timed->push(e);
+            guard.unlock();
+
+            state->wakeup();
+        }
+    };
+
+    const std::chrono::microseconds slice;
+
+public:
+    // slice is how long one idle period may run items for
+    explicit qt_idle_loop(std::chrono::microseconds slice = std::chrono::milliseconds(1))
+        : slice(slice)
+    {
+    }
+
+    virtual ~qt_idle_loop()
+    {
+    }
+
+    virtual clock_type::time_point now() const {
+        return clock_type::now();
+    }
+
+    // Workers run on the thread that creates them, which must have an
+    // event dispatcher.
+    virtual worker create_worker(composite_subscription cs) const {
+        if (!QAbstractEventDispatcher::instance()) {
+            throw std::logic_error("rxqt: qt_idle_loop worker created on a thread without an event dispatcher");
+        }
+        return worker(cs, std::make_shared<idle_worker>(cs, slice));
+    }
+};
+
+inline scheduler make_qt_idle_loop() {
+    static scheduler instance = make_scheduler<qt_idle_loop>();
+    return instance;
+}
+
+inline scheduler make_qt_idle_loop(std::chrono::microseconds slice) {
+    return make_scheduler<qt_idle_loop>(slice);
+}
+
+// Batches work for UI updates: everything the workers of one qt_frame_loop
+// schedule during a frame interval runs together at the frame boundary,
+// so that several updates to a widget land in one paint cycle. Work runs
+// on the application's main thread unless another thread is given, or on
+// the creating thread when there is no application yet.
+struct qt_frame_loop : public scheduler_interface
+{
+private:
+    typedef qt_frame_loop this_type;
+    qt_frame_loop(const this_type&);
+
+    struct frame_worker : public worker_interface
+    {
+        explicit frame_worker(std::shared_ptr<detail::qt_frame_clock> clock)
+            : clock(std::move(clock))
+        {
+        }
+
+        virtual ~frame_worker()
+        {
         }
 
         virtual clock_type::time_point now() const {
@@ -139,32 +2610,34 @@ private:
         }
 
         virtual void schedule(const schedulable& scbl) const {
-            schedule(now(), scbl);
+            if (scbl.is_subscribed()) {
+                clock->push(scbl);
+            }
         }
 
         virtual void schedule(clock_type::time_point when, const schedulable& scbl) const {
-            QObject stub; {
-                auto keepAlive = state;
-                std::unique_lock<std::mutex> guard(keepAlive->lock);
-                if (scbl.is_subscribed()) {
-                    keepAlive->q.push(qtimer_worker_state::item_type(when, scbl));
-                    keepAlive->r.reset(false);
-                }
-                guard.unlock();
-
-                QObject::connect(&stub, &QObject::destroyed, keepAlive.get(), [keepAlive]() {
-                    keepAlive->handle_queue();
-                });
+            if (!scbl.is_subscribed()) {
+                return;
+            }
+            if (when <= now()) {
+                clock->push(scbl);
+            } else {
+                clock->push(when, scbl);
             }
         }
+
+        std::shared_ptr<detail::qt_frame_clock> clock;
     };
 
+    std::shared_ptr<detail::qt_frame_clock> clock;
+
 public:
-    qt_event_loop()
+    explicit qt_frame_loop(std::chrono::milliseconds interval = std::chrono::milliseconds(16), QThread* thread = nullptr)
+        : clock(std::make_shared<detail::qt_frame_clock>(interval, thread ? thread : main_thread()))
     {
     }
 
-    virtual ~qt_event_loop()
+    virtual ~qt_frame_loop()
     {
     }
 
@@ -173,15 +2646,33 @@ public:
     }
 
     virtual worker create_worker(composite_subscription cs) const {
-        return worker(cs, std::make_shared<qtimer_worker>(cs));
+        return worker(cs, std::make_shared<frame_worker>(clock));
+    }
+
+private:
+    static QThread* main_thread()
+    {
+        auto app = QCoreApplication::instance();
+        return app ? app->thread() : QThread::currentThread();
     }
 };
 
-inline scheduler make_qt_event_loop() {
-    static scheduler instance = make_scheduler<qt_event_loop>();
+// Shares one frame clock among everything that uses it.
+inline scheduler make_qt_frame_loop() {
+    static scheduler instance = make_scheduler<qt_frame_loop>();
     return instance;
 }
 
+// A separate frame clock. Keep the scheduler to batch with it.
+inline scheduler make_qt_frame_loop(std::chrono::milliseconds interval) {
+    return make_scheduler<qt_frame_loop>(interval);
+}
+
+// A separate frame clock running on thread.
+inline scheduler make_qt_frame_loop(std::chrono::milliseconds interval, QThread* thread) {
+    return make_scheduler<qt_frame_loop>(interval, thread);
+}
+
 }
 
 inline serialize_one_worker serialize_qt_event_loop() {
@@ -189,11 +2680,82 @@ inline serialize_one_worker serialize_qt_event_loop() {
     return r;
 }
 
+inline serialize_one_worker serialize_qt_event_loop(rxsc::qt_event_loop_options options) {
+    return serialize_one_worker(rxsc::make_qt_event_loop(std::move(options)));
+}
+
+inline serialize_one_worker serialize_qt_event_loop(QThread* thread) {
+    return serialize_one_worker(rxsc::make_qt_event_loop(thread));
+}
+
+inline serialize_one_worker serialize_qt_event_loop(const QObject* context) {
+    return serialize_one_worker(rxsc::make_qt_event_loop(context));
+}
+
+inline serialize_one_worker serialize_qt_event_loop(rxsc::qt_event_loop_priority priority) {
+    return serialize_one_worker(rxsc::make_qt_event_loop(priority));
+}
+
+inline serialize_one_worker serialize_qt_idle_loop() {
+    static serialize_one_worker r(rxsc::make_qt_idle_loop());
+    return r;
+}
+
+inline serialize_one_worker serialize_qt_frame_loop() {
+    static serialize_one_worker r(rxsc::make_qt_frame_loop());
+    return r;
+}
+
 inline observe_on_one_worker observe_on_qt_event_loop() {
     static observe_on_one_worker r(rxsc::make_qt_event_loop());
     return r;
 }
 
+inline observe_on_one_worker observe_on_qt_event_loop(rxsc::qt_event_loop_options options) {
+    return observe_on_one_worker(rxsc::make_qt_event_loop(std::move(options)));
+}
+
+inline observe_on_one_worker observe_on_qt_event_loop(QThread* thread) {
+    return observe_on_one_worker(rxsc::make_qt_event_loop(thread));
+}
+
+inline observe_on_one_worker observe_on_qt_event_loop(const QObject* context) {
+    return observe_on_one_worker(rxsc::make_qt_event_loop(context));
+}
+
+inline observe_on_one_worker observe_on_qt_event_loop(rxsc::qt_event_loop_priority priority) {
+    return observe_on_one_worker(rxsc::make_qt_event_loop(priority));
+}
+
+// Like observe_on_qt_event_loop(), but values arriving on the loop thread
+// while it is idle are delivered inline.
+inline observe_on_one_worker observe_on_qt_event_loop_inline() {
+    static observe_on_one_worker r(rxsc::make_qt_event_loop_inline());
+    return r;
+}
+
+inline observe_on_one_worker observe_on_qt_idle_loop() {
+    static observe_on_one_worker r(rxsc::make_qt_idle_loop());
+    return r;
+}
+
+inline observe_on_one_worker observe_on_qt_frame_loop() {
+    static observe_on_one_worker r(rxsc::make_qt_frame_loop());
+    return r;
+}
+
+// Emits stats->metrics() every period on the event loop of the thread that
+// subscribes, e.g. for alerting on a saturated GUI thread.
+inline observable<rxsc::qt_event_loop_metrics> qt_event_loop_metrics_stream(std::shared_ptr<rxsc::qt_event_loop_stats> stats,
+                                                                             rxsc::scheduler::clock_type::duration period) {
+    return observable<>::create<rxsc::qt_event_loop_metrics>([stats, period](subscriber<rxsc::qt_event_loop_metrics> s) {
+        auto w = rxsc::make_qt_event_loop().create_worker(s.get_subscription());
+        w.schedule_periodically(w.now() + period, period, [stats, s](const rxsc::schedulable&) {
+            s.on_next(stats->metrics());
+        });
+    });
+}
+
 }
 
 
@@ -4,6 +4,8 @@
 #define RXQT_H
 
 #include <rxqt_signal.hpp>
+#include <rxqt_metasignal.hpp>
+#include <rxqt_property.hpp>
 #include <rxqt_slot.hpp>
 #include <rxqt_event.hpp>
 #include <rxqt-eventloop.hpp>
@@ -4,7 +4,20 @@
 #define RXQT_EVENT_HPP
 
 #include <rxcpp/rx.hpp>
+#include <QCoreApplication>
 #include <QEvent>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace rxqt {
 
@@ -12,40 +25,472 @@ namespace event {
 
 namespace detail {
 
-class EventFilter: public QObject {
+// Subscribers by event type. A subscriber may be filed under several types,
+// with one key. The lists are copy-on-write, so they may change while an
+// event is being delivered. Not locked itself.
+template <class S>
+class event_table {
 public:
-    EventFilter(QObject* parent, QEvent::Type type, rxcpp::subscriber<QEvent*> s): QObject(parent), type(type), s(s) {}
-    ~EventFilter(){
-        s.on_completed();
+    using list_type = std::vector<std::pair<std::uint64_t, S>>;
+
+    // Returns the types that had no subscriber before.
+    std::vector<int> add(const std::vector<QEvent::Type>& types, std::uint64_t key, const S& s){
+        std::vector<int> populated;
+        for(auto type : types){
+            auto& subscribers = table[type];
+            if(!subscribers){
+                populated.push_back(type);
+            }
+            auto next = subscribers ? std::make_shared<list_type>(*subscribers) : std::make_shared<list_type>();
+            next->emplace_back(key, s);
+            subscribers = std::move(next);
+        }
+        return populated;
+    }
+
+    // Returns the types left without subscribers.
+    std::vector<int> remove(const std::vector<QEvent::Type>& types, std::uint64_t key){
+        std::vector<int> emptied;
+        for(auto type : types){
+            auto it = table.find(type);
+            if(it == table.end()){
+                continue;
+            }
+            auto next = std::make_shared<list_type>();
+            next->reserve(it->second->size());
+            for(auto& s : *it->second){
+                if(s.first != key){
+                    next->push_back(s);
+                }
+            }
+            if(next->empty()){
+                table.erase(it);
+                emptied.push_back(type);
+            } else {
+                it->second = std::move(next);
+            }
+        }
+        return emptied;
+    }
+
+    std::shared_ptr<const list_type> find(int type) const {
+        auto it = table.find(type);
+        return it != table.end() ? it->second : nullptr;
+    }
+
+    bool empty() const {
+        return table.empty();
+    }
+
+    std::vector<int> types() const {
+        std::vector<int> result;
+        for(auto& entry : table){
+            result.push_back(entry.first);
+        }
+        return result;
+    }
+
+    // Empties the table, returning each subscriber once.
+    std::vector<S> take(){
+        std::vector<S> result;
+        std::unordered_set<std::uint64_t> seen;
+        for(auto& entry : table){
+            for(auto& s : *entry.second){
+                if(seen.insert(s.first).second){
+                    result.push_back(s.second);
+                }
+            }
+        }
+        table.clear();
+        return result;
+    }
+
+private:
+    std::unordered_map<int, std::shared_ptr<const list_type>> table;
+};
+
+template <class S, class... A>
+void deliver(const std::shared_ptr<const typename event_table<S>::list_type>& subscribers, A&&... a){
+    if(subscribers){
+        for(auto& s : *subscribers){
+            if(s.second.is_subscribed()){
+                s.second.on_next(a...);
+            }
+        }
+    }
+}
+
+inline std::uint64_t next_key(){
+    static std::atomic<std::uint64_t> key(0);
+    return ++key;
+}
+
+// Sorted, without duplicates, so that each type is filed once.
+inline std::vector<QEvent::Type> normalized(std::vector<QEvent::Type> types){
+    std::sort(types.begin(), types.end());
+    types.erase(std::unique(types.begin(), types.end()), types.end());
+    return types;
+}
+
+// The one event filter rxqt installs on an object, shared by all its
+// from_event subscriptions. Subscribers are looked up by event type, so an
+// event costs one table lookup however many subscriptions wait for other
+// types.
+class EventDispatcher: public QObject {
+public:
+    using subscriber_type = rxcpp::subscriber<QEvent*>;
+
+    ~EventDispatcher(){
+        std::vector<subscriber_type> remaining;
+        {
+            std::unique_lock<std::mutex> guard(registry_lock());
+            auto& dispatchers = registry();
+            auto it = dispatchers.find(target);
+            if(it != dispatchers.end() && it->second == this){
+                dispatchers.erase(it);
+            }
+            std::unique_lock<std::mutex> table_guard(lock);
+            remaining = table.take();
+        }
+        for(auto& s : remaining){
+            s.on_completed();
+        }
+    }
+
+    // Subscribes s to events of the given types on qobject, installing the
+    // dispatcher on first use. Call on the object's thread.
+    static void subscribe(QObject* qobject, const std::vector<QEvent::Type>& types, subscriber_type s){
+        std::unique_lock<std::mutex> guard(registry_lock());
+        auto& dispatchers = registry();
+        auto& dispatcher = dispatchers[qobject];
+        if(!dispatcher){
+            dispatcher = new EventDispatcher(qobject);
+            qobject->installEventFilter(dispatcher);
+        }
+        const std::uint64_t key = next_key();
+        EventDispatcher* d = dispatcher;
+        {
+            std::unique_lock<std::mutex> table_guard(d->lock);
+            d->table.add(types, key, s);
+        }
+        guard.unlock();
+
+        s.add([qobject, d, types, key](){
+            std::unique_lock<std::mutex> guard(registry_lock());
+            auto& dispatchers = registry();
+            auto it = dispatchers.find(qobject);
+            // gone with its object, or replaced after running empty
+            if(it == dispatchers.end() || it->second != d){
+                return;
+            }
+            std::unique_lock<std::mutex> table_guard(d->lock);
+            d->table.remove(types, key);
+            if(d->table.empty()){
+                dispatchers.erase(it);
+                // a deleted filter drops out of the object's filter list
+                d->deleteLater();
+            }
+        });
+    }
+
+    bool eventFilter(QObject* obj, QEvent* event){
+        std::shared_ptr<const event_table<subscriber_type>::list_type> subscribers;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            subscribers = table.find(event->type());
+        }
+        deliver<subscriber_type>(subscribers, event);
+        return QObject::eventFilter(obj, event);
+    }
+
+private:
+    explicit EventDispatcher(QObject* target): QObject(target), target(target) {}
+
+    static std::mutex& registry_lock(){
+        static std::mutex m;
+        return m;
+    }
+
+    static std::unordered_map<QObject*, EventDispatcher*>& registry(){
+        static std::unordered_map<QObject*, EventDispatcher*> dispatchers;
+        return dispatchers;
+    }
+
+    QObject* target;
+    std::mutex lock;
+    event_table<subscriber_type> table;
+};
+
+// The application event filter behind from_application_event, one for all
+// its subscriptions. A bitset of the types anybody waits for turns most
+// events away without taking the lock; the rest are looked up among the
+// subscriptions to any object, and among those to the receiver, hashed by
+// object.
+class ApplicationEventDispatcher: public QObject {
+public:
+    using subscriber_type = rxcpp::subscriber<QEvent*>;
+    using any_subscriber_type = rxcpp::subscriber<std::tuple<QObject*, QEvent*>>;
+
+    ~ApplicationEventDispatcher(){
+        std::vector<any_subscriber_type> remaining_any;
+        std::vector<subscriber_type> remaining;
+        {
+            std::unique_lock<std::mutex> guard(lock());
+            if(instance() == this){
+                instance() = nullptr;
+            }
+            remaining_any = any.take();
+            for(auto& entry : objects){
+                QObject::disconnect(entry.second.destroyed);
+                auto taken = entry.second.subscribers.take();
+                remaining.insert(remaining.end(), taken.begin(), taken.end());
+            }
+            objects.clear();
+        }
+        for(auto& s : remaining_any){
+            s.on_completed();
+        }
+        for(auto& s : remaining){
+            s.on_completed();
+        }
+    }
+
+    // Subscribes s to events of the given types sent to any object.
+    static void subscribe(const std::vector<QEvent::Type>& types, any_subscriber_type s){
+        std::unique_lock<std::mutex> guard(lock());
+        auto d = acquire();
+        const std::uint64_t key = next_key();
+        d->populated(d->any.add(types, key, s));
+        guard.unlock();
+
+        s.add([d, types, key](){
+            std::unique_lock<std::mutex> guard(lock());
+            if(instance() != d){
+                return;
+            }
+            d->emptied(d->any.remove(types, key));
+            d->release_if_empty();
+        });
+    }
+
+    // Subscribes s to events of the given types sent to qobject.
+    static void subscribe(QObject* qobject, const std::vector<QEvent::Type>& types, subscriber_type s){
+        std::unique_lock<std::mutex> guard(lock());
+        auto d = acquire();
+        auto& watched = d->objects[qobject];
+        if(!watched.destroyed){
+            watched.destroyed = QObject::connect(qobject, &QObject::destroyed, d, [d, qobject](){
+                d->forget(qobject);
+            }, Qt::DirectConnection);
+        }
+        const std::uint64_t key = next_key();
+        d->populated(watched.subscribers.add(types, key, s));
+        guard.unlock();
+
+        s.add([d, qobject, types, key](){
+            std::unique_lock<std::mutex> guard(lock());
+            if(instance() != d){
+                return;
+            }
+            auto it = d->objects.find(qobject);
+            if(it == d->objects.end()){
+                return;
+            }
+            d->emptied(it->second.subscribers.remove(types, key));
+            if(it->second.subscribers.empty()){
+                QObject::disconnect(it->second.destroyed);
+                d->objects.erase(it);
+            }
+            d->release_if_empty();
+        });
     }
 
     bool eventFilter(QObject* obj, QEvent* event){
-        if(event->type() == type){
-            s.on_next(event);
+        const int type = event->type();
+        if(!wanted(type)){
+            return QObject::eventFilter(obj, event);
         }
+        std::shared_ptr<const event_table<any_subscriber_type>::list_type> any_subscribers;
+        std::shared_ptr<const event_table<subscriber_type>::list_type> subscribers;
+        {
+            std::unique_lock<std::mutex> guard(lock());
+            any_subscribers = any.find(type);
+            auto it = objects.find(obj);
+            if(it != objects.end()){
+                subscribers = it->second.subscribers.find(type);
+            }
+        }
+        deliver<subscriber_type>(subscribers, event);
+        deliver<any_subscriber_type>(any_subscribers, std::make_tuple(obj, event));
         return QObject::eventFilter(obj, event);
     }
+
 private:
-    QEvent::Type type;
-    rxcpp::subscriber<QEvent*> s;
+    struct watched_object {
+        event_table<subscriber_type> subscribers;
+        QMetaObject::Connection destroyed;
+    };
+
+    ApplicationEventDispatcher(): QObject(QCoreApplication::instance()) {
+        for(auto& word : bits){
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static std::mutex& lock(){
+        static std::mutex m;
+        return m;
+    }
+
+    static ApplicationEventDispatcher*& instance(){
+        static ApplicationEventDispatcher* d = nullptr;
+        return d;
+    }
+
+    static ApplicationEventDispatcher* acquire(){
+        auto& d = instance();
+        if(!d){
+            d = new ApplicationEventDispatcher();
+            QCoreApplication::instance()->installEventFilter(d);
+        }
+        return d;
+    }
+
+    bool wanted(int type) const {
+        if(type < 0 || type > QEvent::MaxUser){
+            return false;
+        }
+        return bits[type / 64].load(std::memory_order_relaxed) & (std::uint64_t(1) << (type % 64));
+    }
+
+    // One count per table a type is filed in; the bit is set while any is.
+    void populated(const std::vector<int>& types){
+        for(auto type : types){
+            if(type >= 0 && type <= QEvent::MaxUser && counts[type]++ == 0){
+                bits[type / 64].fetch_or(std::uint64_t(1) << (type % 64), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void emptied(const std::vector<int>& types){
+        for(auto type : types){
+            auto it = counts.find(type);
+            if(it != counts.end() && --it->second == 0){
+                counts.erase(it);
+                bits[type / 64].fetch_and(~(std::uint64_t(1) << (type % 64)), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void release_if_empty(){
+        if(any.empty() && objects.empty()){
+            instance() = nullptr;
+            // a deleted filter drops out of the application's filter list
+            deleteLater();
+        }
+    }
+
+    void forget(QObject* qobject){
+        std::vector<subscriber_type> remaining;
+        {
+            std::unique_lock<std::mutex> guard(lock());
+            if(instance() != this){
+                return;
+            }
+            auto it = objects.find(qobject);
+            if(it == objects.end()){
+                return;
+            }
+            emptied(it->second.subscribers.types());
+            remaining = it->second.subscribers.take();
+            objects.erase(it);
+            release_if_empty();
+        }
+        for(auto& s : remaining){
+            s.on_completed();
+        }
+    }
+
+    std::array<std::atomic<std::uint64_t>, (QEvent::MaxUser + 1) / 64> bits;
+    std::unordered_map<int, int> counts;
+    event_table<any_subscriber_type> any;
+    std::unordered_map<QObject*, watched_object> objects;
 };
 
 } // detail
 
 } // event
 
-rxcpp::observable<QEvent*>
-from_event(QObject* qobject, QEvent::Type type)
+inline rxcpp::observable<QEvent*>
+from_event(QObject* qobject, std::vector<QEvent::Type> types)
 {
     if(!qobject) return rxcpp::sources::never<QEvent*>();
 
+    types = event::detail::normalized(std::move(types));
+    return rxcpp::observable<>::create<QEvent*>(
+        [qobject, types](rxcpp::subscriber<QEvent*> s){
+            event::detail::EventDispatcher::subscribe(qobject, types, s);
+        }
+    );
+}
+
+inline rxcpp::observable<QEvent*>
+from_event(QObject* qobject, std::initializer_list<QEvent::Type> types)
+{
+    return from_event(qobject, std::vector<QEvent::Type>(types));
+}
+
+inline rxcpp::observable<QEvent*>
+from_event(QObject* qobject, QEvent::Type type)
+{
+    return from_event(qobject, std::vector<QEvent::Type>{type});
+}
+
+// Events of the given types sent to any object of the application thread,
+// with their receiver, through one application event filter. Subscribe on
+// the application thread.
+inline rxcpp::observable<std::tuple<QObject*, QEvent*>>
+from_application_event(std::vector<QEvent::Type> types)
+{
+    using value_type = std::tuple<QObject*, QEvent*>;
+    if(!QCoreApplication::instance()) return rxcpp::sources::never<value_type>();
+
+    types = event::detail::normalized(std::move(types));
+    return rxcpp::observable<>::create<value_type>(
+        [types](rxcpp::subscriber<value_type> s){
+            event::detail::ApplicationEventDispatcher::subscribe(types, s);
+        }
+    );
+}
+
+inline rxcpp::observable<std::tuple<QObject*, QEvent*>>
+from_application_event(std::initializer_list<QEvent::Type> types)
+{
+    return from_application_event(std::vector<QEvent::Type>(types));
+}
+
+// Events of the given types sent to qobject, seen by the application event
+// filter rather than a filter on the object: for watching many objects at
+// once. Completes when the object is destroyed.
+inline rxcpp::observable<QEvent*>
+from_application_event(QObject* qobject, std::vector<QEvent::Type> types)
+{
+    if(!qobject || !QCoreApplication::instance()) return rxcpp::sources::never<QEvent*>();
+
+    types = event::detail::normalized(std::move(types));
     return rxcpp::observable<>::create<QEvent*>(
-        [qobject, type](rxcpp::subscriber<QEvent*> s){
-            qobject->installEventFilter(new event::detail::EventFilter(qobject, type, s));
+        [qobject, types](rxcpp::subscriber<QEvent*> s){
+            event::detail::ApplicationEventDispatcher::subscribe(qobject, types, s);
         }
     );
 }
 
+inline rxcpp::observable<QEvent*>
+from_application_event(QObject* qobject, std::initializer_list<QEvent::Type> types)
+{
+    return from_application_event(qobject, std::vector<QEvent::Type>(types));
+}
+
 } // rxqt
 
 #endif // RXQT_EVENT_HPP
@@ -0,0 +1,156 @@
+#pragma once
+
+#ifndef RXQT_METASIGNAL_HPP
+#define RXQT_METASIGNAL_HPP
+
+#include <rxcpp/rx.hpp>
+#include <QObject>
+#include <QMetaMethod>
+#include <QVariant>
+#include <QVector>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace rxqt {
+
+namespace signal {
+
+namespace detail {
+
+// The argument types of a signal, resolved once when the observable is
+// made and shared by its subscriptions.
+inline QVector<int> meta_signal_types(const QMetaMethod& method)
+{
+    QVector<int> types;
+    types.reserve(method.parameterCount());
+    for (int i = 0; i != method.parameterCount(); ++i) {
+        int type = method.parameterType(i);
+        if (type == QMetaType::UnknownType) {
+            type = QMetaType::type(method.parameterTypes().at(i));
+        }
+        types.append(type);
+    }
+    return types;
+}
+
+// args[0] is the return value, the arguments follow. Emissions only wrap
+// the argument pointers.
+inline QVariantList meta_signal_arguments(const QVector<int>& types, void** args)
+{
+    QVariantList values;
+    values.reserve(types.size());
+    for (int i = 0; i != types.size(); ++i) {
+        if (types[i] == QMetaType::QVariant) {
+            values.append(*static_cast<const QVariant*>(args[i + 1]));
+        } else {
+            values.append(QVariant(types[i], args[i + 1]));
+        }
+    }
+    return values;
+}
+
+// Receives one signal through qt_metacall(), the way QSignalSpy does, and
+// hands f the raw argument array.
+class meta_signal_receiver : public QObject
+{
+public:
+    explicit meta_signal_receiver(std::function<void(void**)> f)
+        : f(std::move(f))
+    {
+    }
+
+    // The index to connect the signal to, the first one past QObject's own
+    // methods.
+    static int slot_index()
+    {
+        return QObject::staticMetaObject.methodCount();
+    }
+
+    int qt_metacall(QMetaObject::Call call, int id, void** args)
+    {
+        id = QObject::qt_metacall(call, id, args);
+        if (id < 0) {
+            return id;
+        }
+        if (call == QMetaObject::InvokeMetaMethod) {
+            if (id == 0) {
+                f(args);
+            }
+            --id;
+        }
+        return id;
+    }
+
+private:
+    std::function<void(void**)> f;
+};
+
+} // detail
+
+} // signal
+
+// Convert a signal known only at runtime to an observable of its arguments.
+// Arguments of unregistered types arrive as invalid QVariants.
+inline rxcpp::observable<QVariantList> from_signal(const QObject* qobject, const QMetaMethod& method)
+{
+    if (!qobject) return rxcpp::sources::never<QVariantList>();
+    if (method.methodType() != QMetaMethod::Signal) {
+        return rxcpp::sources::error<QVariantList>(std::invalid_argument("rxqt::from_signal: not a signal"));
+    }
+
+    const int index = method.methodIndex();
+    const QVector<int> types = signal::detail::meta_signal_types(method);
+    return rxcpp::observable<>::create<QVariantList>(
+        [qobject, types, index](const rxcpp::subscriber<QVariantList>& s){
+            using receiver_type = signal::detail::meta_signal_receiver;
+            // lives in the sender's thread, so that it is deleted there,
+            // after any emission running into it
+            auto receiver = new receiver_type([types, s](void** args) {
+                s.on_next(signal::detail::meta_signal_arguments(types, args));
+            });
+            receiver->moveToThread(qobject->thread());
+            auto c = QMetaObject::connect(qobject, index, receiver, receiver_type::slot_index(), Qt::DirectConnection, nullptr);
+            auto d = QObject::connect(qobject, &QObject::destroyed, [s](){
+                s.on_completed();
+            });
+            s.add([c, d, receiver]() {
+                QObject::disconnect(c);
+                QObject::disconnect(d);
+                receiver->deleteLater();
+            });
+        }
+    );
+}
+
+// Same, finding the signal by signature ("valueChanged(int)", also as
+// SIGNAL(valueChanged(int))) or by bare name, which picks the most derived
+// signal of that name.
+inline rxcpp::observable<QVariantList> from_signal(const QObject* qobject, const char* signal)
+{
+    if (!qobject) return rxcpp::sources::never<QVariantList>();
+
+    if (*signal == '0' + QSIGNAL_CODE) {
+        ++signal;
+    }
+    auto meta = qobject->metaObject();
+    int index = -1;
+    if (std::strchr(signal, '(')) {
+        index = meta->indexOfSignal(QMetaObject::normalizedSignature(signal).constData());
+    } else {
+        for (int i = meta->methodCount() - 1; i >= 0 && index < 0; --i) {
+            auto m = meta->method(i);
+            if (m.methodType() == QMetaMethod::Signal && m.name() == signal) {
+                index = i;
+            }
+        }
+    }
+    if (index < 0) {
+        return rxcpp::sources::error<QVariantList>(std::invalid_argument(std::string("rxqt::from_signal: no signal ") + signal));
+    }
+    return from_signal(qobject, meta->method(index));
+}
+
+} // rxqt
+
+#endif // RXQT_METASIGNAL_HPP
@@ -0,0 +1,227 @@
+#pragma once
+
+#ifndef RXQT_PROPERTY_HPP
+#define RXQT_PROPERTY_HPP
+
+#include <rxcpp/rx.hpp>
+#include <QObject>
+#include <QMetaProperty>
+#include <QPointer>
+#include <QVariant>
+#include <rxqt_signal.hpp>
+#include <rxqt_metasignal.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rxqt {
+
+namespace property {
+
+namespace detail {
+
+// One property of one object, shared by all its subscribers. Reads the
+// property when it notifies and passes the value on only when it differs
+// from the last one.
+template <class V>
+class property_hub : public signal::detail::signal_hub<V>
+{
+public:
+    explicit property_hub(std::function<V()> read)
+        : read(std::move(read))
+    {
+    }
+
+    void changed()
+    {
+        V value = read();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!last.empty() && last.get() == value) {
+                return;
+            }
+            last.reset(value);
+        }
+        this->publish(value);
+    }
+
+    // Gives a new subscriber, already added, the current value. Should it
+    // differ from the last one, the others get it too.
+    void start(const rxcpp::subscriber<V>& s)
+    {
+        V value = read();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (last.empty() || !(last.get() == value)) {
+                last.reset(value);
+                guard.unlock();
+                this->publish(value);
+                return;
+            }
+        }
+        s.on_next(value);
+    }
+
+    void disconnect()
+    {
+        signal::detail::signal_hub<V>::disconnect();
+        if (receiver) {
+            receiver->deleteLater();
+        }
+    }
+
+    // set when the notify signal is received through a meta_signal_receiver
+    QPointer<QObject> receiver;
+
+private:
+    std::function<V()> read;
+    std::mutex lock;
+    rxcpp::util::maybe<V> last;
+};
+
+// Property hubs by object and id, per value type, in a registry like the
+// one of from_signal_shared().
+template <class V>
+struct property_registry
+{
+    using hub_type = property_hub<V>;
+    using key_type = std::pair<const QObject*, std::string>;
+    using hubs = signal::detail::hub_registry<hub_type, hub_type, key_type>;
+
+    // connect(hub) hooks a new hub up to the notify signal. The property is
+    // read outside the registry lock, so a getter may observe other
+    // properties.
+    static rxcpp::observable<V> create(const QObject* qobject, std::string id, std::function<V()> read,
+                                       std::function<void(const std::shared_ptr<hub_type>&)> connect)
+    {
+        return rxcpp::observable<>::create<V>(
+            [qobject, id, read, connect](const rxcpp::subscriber<V>& s) {
+                auto hub = hubs::subscribe(qobject, key_type(qobject, id), s, [&read, &connect]() {
+                    auto hub = std::make_shared<hub_type>(read);
+                    connect(hub);
+                    return hub;
+                });
+                hub->start(s);
+            }
+        );
+    }
+};
+
+// A stable id for a getter, made of the address of a tag for its type and
+// its place among the getters of that type seen so far. Member pointers
+// can only be compared, their bytes are not a key.
+template <class Q, class G>
+struct getter_tag
+{
+    using getter_type = G (Q::*)() const;
+
+    static std::string id(getter_type getter)
+    {
+        std::unique_lock<std::mutex> guard(lock());
+        auto& seen = getters();
+        auto it = std::find(seen.begin(), seen.end(), getter);
+        auto index = it - seen.begin();
+        if (it == seen.end()) {
+            seen.push_back(getter);
+        }
+        return std::to_string(reinterpret_cast<std::uintptr_t>(&tag)) + "." + std::to_string(index);
+    }
+
+private:
+    static std::mutex& lock()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::vector<getter_type>& getters()
+    {
+        static std::vector<getter_type> seen;
+        return seen;
+    }
+
+    static const char tag;
+};
+
+template <class Q, class G>
+const char getter_tag<Q, G>::tag = 0;
+
+} // detail
+
+} // property
+
+// Observe a Q_PROPERTY by name: starts with the current value, then emits
+// the new value on each NOTIFY signal where it actually changed. All
+// subscribers to a property of an object share one connection. Subscribe
+// on the object's thread.
+inline rxcpp::observable<QVariant> from_property(const QObject* qobject, const char* name)
+{
+    if (!qobject) return rxcpp::sources::never<QVariant>();
+
+    auto meta = qobject->metaObject();
+    const int index = meta->indexOfProperty(name);
+    if (index < 0) {
+        return rxcpp::sources::error<QVariant>(std::invalid_argument(std::string("rxqt::from_property: no property ") + name));
+    }
+    auto property = meta->property(index);
+    auto read = [qobject, property]() {
+        return property.read(qobject);
+    };
+    if (!property.hasNotifySignal()) {
+        return rxcpp::observable<>::defer([read]() {
+            return rxcpp::observable<>::just(read());
+        }).as_dynamic();
+    }
+
+    using hub_type = property::detail::property_hub<QVariant>;
+    const int notify = property.notifySignalIndex();
+    return property::detail::property_registry<QVariant>::create(qobject, "p" + std::to_string(index), read,
+        [qobject, notify](const std::shared_ptr<hub_type>& hub) {
+            using receiver_type = signal::detail::meta_signal_receiver;
+            std::weak_ptr<hub_type> weak = hub;
+            auto receiver = new receiver_type([weak](void**) {
+                if (auto hub = weak.lock()) {
+                    hub->changed();
+                }
+            });
+            receiver->moveToThread(qobject->thread());
+            hub->receiver = receiver;
+            hub->signal = QMetaObject::connect(qobject, notify, receiver, receiver_type::slot_index(), Qt::DirectConnection, nullptr);
+        });
+}
+
+// The typed form: reads through getter on each notify, without going
+// through QVariant or the metaobject.
+template <class P, class Q, class G, class R, class ...Args>
+auto from_property(const P* qobject, G (Q::*getter)() const, R (Q::*notify)(Args...))
+{
+    static_assert(std::is_base_of<Q, P>::value, "Given property is not member of sender class nor it's base class.");
+    using value_type = std::remove_cv_t<std::remove_reference_t<G>>;
+    using hub_type = property::detail::property_hub<value_type>;
+
+    if (!qobject) return rxcpp::sources::never<value_type>().as_dynamic();
+
+    const Q* q = static_cast<const Q*>(qobject);
+    // getters sharing a notify signal get their own hubs
+    auto id = "t" + std::to_string(QMetaMethod::fromSignal(notify).methodIndex()) + "." + property::detail::getter_tag<Q, G>::id(getter);
+    std::function<value_type()> read = [q, getter]() -> value_type {
+        return (q->*getter)();
+    };
+    return property::detail::property_registry<value_type>::create(q, id, read,
+        [q, notify](const std::shared_ptr<hub_type>& hub) {
+            std::weak_ptr<hub_type> weak = hub;
+            hub->signal = QObject::connect(q, notify, [weak]() {
+                if (auto hub = weak.lock()) {
+                    hub->changed();
+                }
+            });
+        }).as_dynamic();
+}
+
+} // rxqt
+
+#endif // RXQT_PROPERTY_HPP
@@ -5,13 +5,108 @@
 
 #include <rxcpp/rx.hpp>
 #include <QObject>
+#include <QMetaMethod>
+#include <map>
+#include <mutex>
 
 namespace rxqt {
 
+// The arguments of one emission, as delivered by from_signal_ref(). Fresh
+// from the signal it only refers to the sender's arguments, which are
+// valid for the duration of on_next(). Any copy or move owns a copy of
+// them instead, shared by its own copies, so values that outlive the
+// emission, e.g. queued by observe_on(), stay valid.
+template <class ...Args>
+class signal_args
+{
+public:
+    using tuple_type = std::tuple<std::remove_cv_t<std::remove_reference_t<Args>>...>;
+
+    explicit signal_args(const std::remove_cv_t<std::remove_reference_t<Args>>&... values)
+        : refs(&values...)
+    {
+    }
+
+    signal_args(const signal_args& other)
+        : owned(other.own())
+    {
+        point_at_owned(std::index_sequence_for<Args...>());
+    }
+
+    signal_args(signal_args&& other)
+        : owned(other.own())
+    {
+        point_at_owned(std::index_sequence_for<Args...>());
+    }
+
+    signal_args& operator=(const signal_args& other)
+    {
+        if (this != &other) {
+            owned = other.own();
+            point_at_owned(std::index_sequence_for<Args...>());
+        }
+        return *this;
+    }
+
+    signal_args& operator=(signal_args&& other)
+    {
+        return *this = static_cast<const signal_args&>(other);
+    }
+
+    template <size_t I>
+    const std::tuple_element_t<I, tuple_type>& get() const
+    {
+        return *std::get<I>(refs);
+    }
+
+    tuple_type to_tuple() const
+    {
+        return to_tuple(std::index_sequence_for<Args...>());
+    }
+
+    // false while referring to the sender's arguments
+    bool owns() const
+    {
+        return !!owned;
+    }
+
+private:
+    std::shared_ptr<const tuple_type> own() const
+    {
+        return owned ? owned : std::make_shared<const tuple_type>(to_tuple());
+    }
+
+    template <size_t ...Is>
+    tuple_type to_tuple(std::index_sequence<Is...>) const
+    {
+        return tuple_type(*std::get<Is>(refs)...);
+    }
+
+    template <size_t ...Is>
+    void point_at_owned(std::index_sequence<Is...>)
+    {
+        refs = std::make_tuple(&std::get<Is>(*owned)...);
+    }
+
+    std::tuple<const std::remove_cv_t<std::remove_reference_t<Args>>*...> refs;
+    std::shared_ptr<const tuple_type> owned;
+};
+
 namespace signal {
 
 namespace detail {
 
+// Ties both connections to the subscriber, so that unsubscribing removes
+// them from the sender instead of leaving dead lambdas behind.
+template <class T>
+void disconnect_on_unsubscribe(const rxcpp::subscriber<T>& s, QMetaObject::Connection signal, QMetaObject::Connection destroyed)
+{
+    s.add([signal, destroyed]() {
+        QObject::disconnect(signal);
+        QObject::disconnect(destroyed);
+    });
+}
+
 template <class Q, class T>
 struct from_signal;
 
@@ -28,15 +123,39 @@ struct from_signal<Q, std::tuple<>>
         return rxcpp::observable<>::create<long>(
             [qobject, signal](const rxcpp::subscriber<long>& s){
                 long counter = 0;
-                QObject::connect(qobject, signal, [s, counter]() mutable {
+                auto c = QObject::connect(qobject, signal, [s, counter]() mutable {
                     s.on_next(counter++);
                 });
-                QObject::connect(qobject, &QObject::destroyed, [s](){
+                auto d = QObject::connect(qobject, &QObject::destroyed, [s](){
                     s.on_completed();
                 });
+                disconnect_on_unsubscribe(s, c, d);
             }
         );
     }
+
+    template <class S, class H>
+    static QMetaObject::Connection connect_shared(const Q* qobject, S signal, std::shared_ptr<H> hub)
+    {
+        long counter = 0;
+        return QObject::connect(qobject, signal, [hub, counter]() mutable {
+            hub->publish(counter++);
+        });
+    }
+
+    // What a shared hub delivers to: counts from 0 for every subscriber,
+    // like from_signal(), rather than from when the hub connected.
+    static rxcpp::subscriber<long> per_subscriber(const rxcpp::subscriber<long>& s)
+    {
+        auto counter = std::make_shared<long>(0);
+        return rxcpp::make_subscriber<long>(s.get_subscription(), [s, counter](long) {
+            s.on_next((*counter)++);
+        }, [s](std::exception_ptr e) {
+            s.on_error(e);
+        }, [s]() {
+            s.on_completed();
+        });
+    }
 };
 
 template <class Q, class A0>
@@ -51,15 +170,29 @@ struct from_signal<Q, std::tuple<A0>>
 
         return rxcpp::observable<>::create<value_type>(
             [qobject, signal](const rxcpp::subscriber<value_type>& s) {
-                 QObject::connect(qobject, signal, [s](const A0& v0) {
+                 auto c = QObject::connect(qobject, signal, [s](const A0& v0) {
                      s.on_next(v0);
                  });
-                 QObject::connect(qobject, &QObject::destroyed, [s]() {
+                 auto d = QObject::connect(qobject, &QObject::destroyed, [s]() {
                      s.on_completed();
                  });
+                 disconnect_on_unsubscribe(s, c, d);
              }
         );
     }
+
+    template <class S, class H>
+    static QMetaObject::Connection connect_shared(const Q* qobject, S signal, std::shared_ptr<H> hub)
+    {
+        return QObject::connect(qobject, signal, [hub](const A0& v0) {
+            hub->publish(v0);
+        });
+    }
+
+    static const rxcpp::subscriber<value_type>& per_subscriber(const rxcpp::subscriber<value_type>& s)
+    {
+        return s;
+    }
 };
 
 template <class Q, class ...Args>
@@ -74,12 +207,485 @@ struct from_signal<Q, std::tuple<Args...>>
 
         return rxcpp::observable<>::create<value_type>(
             [qobject, signal](const rxcpp::subscriber<value_type>& s){
-                QObject::connect(qobject, signal, [s](const Args&... values){
+                auto c = QObject::connect(qobject, signal, [s](const Args&... values){
                     s.on_next(std::make_tuple(values...));
                 });
-                QObject::connect(qobject, &QObject::destroyed, [s](){
+                auto d = QObject::connect(qobject, &QObject::destroyed, [s](){
                     s.on_completed();
                 });
+                disconnect_on_unsubscribe(s, c, d);
+            }
+        );
+    }
+
+    template <class S, class H>
+    static QMetaObject::Connection connect_shared(const Q* qobject, S signal, std::shared_ptr<H> hub)
+    {
+        return QObject::connect(qobject, signal, [hub](const Args&... values) {
+            hub->publish(std::make_tuple(values...));
+        });
+    }
+
+    static const rxcpp::subscriber<value_type>& per_subscriber(const rxcpp::subscriber<value_type>& s)
+    {
+        return s;
+    }
+};
+
+template <class Q, class T>
+struct from_signal_ref;
+
+template <class Q, class ...Args>
+struct from_signal_ref<Q, std::tuple<Args...>>
+{
+    using value_type = signal_args<Args...>;
+
+    template <class S>
+    static rxcpp::observable<value_type> create(const Q* qobject, S signal)
+    {
+        if(!qobject) return rxcpp::sources::never<value_type>();
+
+        return rxcpp::observable<>::create<value_type>(
+            [qobject, signal](const rxcpp::subscriber<value_type>& s){
+                auto c = QObject::connect(qobject, signal, [s](const Args&... values){
+                    // an lvalue, so that passing it on does not move it
+                    // into an owning copy
+                    value_type view(values...);
+                    s.on_next(view);
+                });
+                auto d = QObject::connect(qobject, &QObject::destroyed, [s](){
+                    s.on_completed();
+                });
+                disconnect_on_unsubscribe(s, c, d);
+            }
+        );
+    }
+};
+
+// The subscribers of one shared (sender, signal) connection. The list is
+// copied on every change, so an emission walks a snapshot without holding
+// a lock and subscribers may come and go from inside on_next().
+template <class V>
+class signal_hub
+{
+public:
+    using entry = std::pair<std::uint64_t, rxcpp::subscriber<V>>;
+    using list = std::vector<entry>;
+
+    signal_hub()
+        : subscribers(std::make_shared<list>())
+        , next_key(0)
+    {
+    }
+
+    // Builds the value once for every subscriber.
+    void publish(const V& value) const
+    {
+        auto current = snapshot();
+        for (auto& e : *current) {
+            e.second.on_next(value);
+        }
+    }
+
+    void complete()
+    {
+        auto current = snapshot();
+        std::atomic_store(&subscribers, std::make_shared<const list>());
+        for (auto& e : *current) {
+            e.second.on_completed();
+        }
+    }
+
+    // The rest is called under the registry lock.
+
+    std::uint64_t add(const rxcpp::subscriber<V>& s)
+    {
+        auto next = std::make_shared<list>(*snapshot());
+        next->emplace_back(++next_key, s);
+        std::atomic_store(&subscribers, std::shared_ptr<const list>(std::move(next)));
+        return next_key;
+    }
+
+    // True when that was the last subscriber.
+    bool remove(std::uint64_t key)
+    {
+        auto next = std::make_shared<list>(*snapshot());
+        next->erase(std::remove_if(next->begin(), next->end(), [key](const entry& e) {
+            return e.first == key;
+        }), next->end());
+        bool empty = next->empty();
+        std::atomic_store(&subscribers, std::shared_ptr<const list>(std::move(next)));
+        return empty;
+    }
+
+    void disconnect()
+    {
+        QObject::disconnect(signal);
+        QObject::disconnect(destroyed);
+    }
+
+    QMetaObject::Connection signal;
+    QMetaObject::Connection destroyed;
+
+private:
+    std::shared_ptr<const list> snapshot() const
+    {
+        return std::atomic_load(&subscribers);
+    }
+
+    std::shared_ptr<const list> subscribers;
+    std::uint64_t next_key;
+};
+
+// Shared hubs by key while they have subscribers, one registry per Tag. A
+// hub completes its subscribers and leaves the registry when its sender is
+// destroyed. Hub needs signal_hub's add(), remove(), complete(),
+// disconnect() and destroyed.
+template <class Tag, class Hub, class Key>
+struct hub_registry
+{
+    // Called under lock(): the hub for key, made by make() if there is none.
+    template <class Make>
+    static std::shared_ptr<Hub> acquire(const QObject* qobject, const Key& key, Make make)
+    {
+        auto& hubs = registry();
+        auto it = hubs.find(key);
+        if (it != hubs.end()) {
+            return it->second;
+        }
+        std::shared_ptr<Hub> hub = make();
+        hubs[key] = hub;
+        std::weak_ptr<Hub> weak = hub;
+        hub->destroyed = QObject::connect(qobject, &QObject::destroyed, [weak, key]() {
+            auto hub = weak.lock();
+            if (!hub) {
+                return;
+            }
+            {
+                std::unique_lock<std::mutex> guard(lock());
+                release(key, hub);
+            }
+            hub->complete();
+        });
+        return hub;
+    }
+
+    // Adds s to the hub for key and removes it again on unsubscribe, the
+    // last one out disconnects the hub.
+    template <class V, class Make>
+    static std::shared_ptr<Hub> subscribe(const QObject* qobject, const Key& key, const rxcpp::subscriber<V>& s, Make make)
+    {
+        std::unique_lock<std::mutex> guard(lock());
+        auto hub = acquire(qobject, key, make);
+        auto k = hub->add(s);
+        guard.unlock();
+        s.add([hub, key, k]() {
+            std::unique_lock<std::mutex> guard(lock());
+            if (hub->remove(k)) {
+                release(key, hub);
+            }
+        });
+        return hub;
+    }
+
+    // Called under lock().
+    static void release(const Key& key, const std::shared_ptr<Hub>& hub)
+    {
+        hub->disconnect();
+        auto& hubs = registry();
+        auto it = hubs.find(key);
+        if (it != hubs.end() && it->second == hub) {
+            hubs.erase(it);
+        }
+    }
+
+    static std::mutex& lock()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+private:
+    static std::map<Key, std::shared_ptr<Hub>>& registry()
+    {
+        static std::map<Key, std::shared_ptr<Hub>> hubs;
+        return hubs;
+    }
+};
+
+// Multicasts one Qt connection per (sender, signal) to all subscribers of
+// from_signal_shared(). The connection is made for the first subscriber
+// and dropped with the last one.
+template <class F>
+struct shared_signal
+{
+    using value_type = typename F::value_type;
+    using hub_type = signal_hub<value_type>;
+    using key_type = std::pair<const QObject*, int>;
+    using hubs = hub_registry<F, hub_type, key_type>;
+
+    template <class Q, class S>
+    static rxcpp::observable<value_type> create(const Q* qobject, S signal)
+    {
+        if (!qobject) return rxcpp::sources::never<value_type>();
+
+        const int index = QMetaMethod::fromSignal(signal).methodIndex();
+        return rxcpp::observable<>::create<value_type>(
+            [qobject, signal, index](const rxcpp::subscriber<value_type>& s) {
+                hubs::subscribe(qobject, key_type(qobject, index), F::per_subscriber(s), [qobject, signal]() {
+                    auto hub = std::make_shared<hub_type>();
+                    hub->signal = F::connect_shared(qobject, signal, hub);
+                    return hub;
+                });
+            }
+        );
+    }
+};
+
+// Buffers the emissions of one from_signal_batched() subscription and
+// hands them to the subscriber as vectors, on the subscriber's worker. A
+// batch goes out when it holds max_count values, or max_delay after its
+// first value, whichever comes first. A timed flush only serves the batch
+// that armed it, should that batch go out early the flush does nothing.
+template <class V>
+class signal_batcher : public std::enable_shared_from_this<signal_batcher<V>>
+{
+public:
+    using batch_type = std::vector<V>;
+
+    signal_batcher(rxcpp::subscriber<batch_type> s, rxcpp::schedulers::worker w, std::size_t max_count, rxcpp::schedulers::scheduler::clock_type::duration max_delay)
+        : s(std::move(s))
+        , w(std::move(w))
+        , max_count(std::max<std::size_t>(max_count, 1))
+        , max_delay(max_delay)
+        , batch(0)
+        , flush_pending(false)
+        , completed(false)
+    {
+    }
+
+    // On the sender's thread.
+    void publish(const V& value)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (completed) {
+            return;
+        }
+        current.push_back(value);
+        if (current.size() >= max_count) {
+            full.push_back(std::move(current));
+            current = batch_type();
+            current.reserve(max_count);
+            ++batch;
+            if (!flush_pending) {
+                flush_pending = true;
+                guard.unlock();
+                schedule_flush();
+            }
+        } else if (current.size() == 1 && !flush_pending) {
+            // a flush on its way takes this batch along
+            auto armed = batch;
+            guard.unlock();
+            schedule_flush(armed);
+        }
+    }
+
+    void complete()
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            completed = true;
+        }
+        schedule_flush();
+    }
+
+private:
+    void schedule_flush()
+    {
+        auto self = this->shared_from_this();
+        w.schedule([self](const rxcpp::schedulers::schedulable&) {
+            self->flush(false, 0);
+        });
+    }
+
+    // max_delay from now, for the batch numbered armed
+    void schedule_flush(std::uint64_t armed)
+    {
+        auto self = this->shared_from_this();
+        w.schedule(w.now() + max_delay, [self, armed](const rxcpp::schedulers::schedulable&) {
+            self->flush(true, armed);
+        });
+    }
+
+    // On the subscriber's worker: everything buffered so far goes out.
+    void flush(bool timed, std::uint64_t armed)
+    {
+        std::vector<batch_type> batches;
+        bool done;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (timed && armed != batch) {
+                return;
+            }
+            batches.swap(full);
+            if (!current.empty()) {
+                batches.push_back(std::move(current));
+                current = batch_type();
+                ++batch;
+            }
+            if (!timed) {
+                flush_pending = false;
+            }
+            done = completed;
+        }
+        for (auto& batch : batches) {
+            s.on_next(std::move(batch));
+        }
+        if (done) {
+            s.on_completed();
+        }
+    }
+
+    rxcpp::subscriber<batch_type> s;
+    rxcpp::schedulers::worker w;
+    const std::size_t max_count;
+    const rxcpp::schedulers::scheduler::clock_type::duration max_delay;
+    std::mutex lock;
+    batch_type current;
+    std::vector<batch_type> full;
+    // numbers current, so a timed flush can tell its batch went out already
+    std::uint64_t batch;
+    bool flush_pending;
+    bool completed;
+};
+
+template <class F>
+struct batched_signal
+{
+    using value_type = typename F::value_type;
+    using batch_type = std::vector<value_type>;
+
+    template <class Q, class S>
+    static rxcpp::observable<batch_type> create(const Q* qobject, S signal, rxcpp::schedulers::scheduler sc,
+                                                std::size_t max_count, rxcpp::schedulers::scheduler::clock_type::duration max_delay)
+    {
+        if (!qobject) return rxcpp::sources::never<batch_type>();
+
+        return rxcpp::observable<>::create<batch_type>(
+            [qobject, signal, sc, max_count, max_delay](const rxcpp::subscriber<batch_type>& s) {
+                auto batcher = std::make_shared<signal_batcher<value_type>>(s, sc.create_worker(s.get_subscription()), max_count, max_delay);
+                auto c = F::connect_shared(qobject, signal, batcher);
+                auto d = QObject::connect(qobject, &QObject::destroyed, [batcher]() {
+                    batcher->complete();
+                });
+                disconnect_on_unsubscribe(s, c, d);
+            }
+        );
+    }
+};
+
+// Holds the latest emission of one from_signal_latest() subscription. At
+// most one delivery is pending on the subscriber's worker at a time, later
+// emissions overwrite the value it will deliver.
+template <class V>
+class signal_conflator : public std::enable_shared_from_this<signal_conflator<V>>
+{
+public:
+    signal_conflator(rxcpp::subscriber<V> s, rxcpp::schedulers::worker w)
+        : s(std::move(s))
+        , w(std::move(w))
+        , pending(false)
+        , completed(false)
+    {
+    }
+
+    // On the sender's thread.
+    void publish(const V& value)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (completed) {
+            return;
+        }
+        latest.reset(value);
+        if (pending) {
+            return;
+        }
+        pending = true;
+        guard.unlock();
+        schedule_delivery();
+    }
+
+    void complete()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        completed = true;
+        if (pending) {
+            // the pending delivery completes after the value
+            return;
+        }
+        pending = true;
+        guard.unlock();
+        schedule_delivery();
+    }
+
+private:
+    void schedule_delivery()
+    {
+        auto self = this->shared_from_this();
+        w.schedule([self](const rxcpp::schedulers::schedulable&) {
+            self->deliver();
+        });
+    }
+
+    // On the subscriber's worker. Emissions arriving while on_next() runs
+    // schedule the next delivery.
+    void deliver()
+    {
+        rxcpp::util::maybe<V> value;
+        bool done;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!latest.empty()) {
+                value.reset(std::move(latest.get()));
+                latest.reset();
+            }
+            pending = false;
+            done = completed;
+        }
+        if (!value.empty()) {
+            s.on_next(std::move(value.get()));
+        }
+        if (done) {
+            s.on_completed();
+        }
+    }
+
+    rxcpp::subscriber<V> s;
+    rxcpp::schedulers::worker w;
+    std::mutex lock;
+    rxcpp::util::maybe<V> latest;
+    bool pending;
+    bool completed;
+};
+
+template <class F>
+struct latest_signal
+{
+    using value_type = typename F::value_type;
+
+    template <class Q, class S>
+    static rxcpp::observable<value_type> create(const Q* qobject, S signal, rxcpp::schedulers::scheduler sc)
+    {
+        if (!qobject) return rxcpp::sources::never<value_type>();
+
+        return rxcpp::observable<>::create<value_type>(
+            [qobject, signal, sc](const rxcpp::subscriber<value_type>& s) {
+                auto conflator = std::make_shared<signal_conflator<value_type>>(s, sc.create_worker(s.get_subscription()));
+                auto c = F::connect_shared(qobject, signal, conflator);
+                auto d = QObject::connect(qobject, &QObject::destroyed, [conflator]() {
+                    conflator->complete();
+                });
+                disconnect_on_unsubscribe(s, c, d);
             }
         );
     }
@@ -146,6 +752,79 @@ auto from_signal(const P* qobject, R(Q::*signal)(Args...))
     return from_signal<sizeof...(Args)>(qobject, signal);
 }
 
+// Like from_signal(), but delivers the arguments as a signal_args view
+// instead of copying them into a tuple on every emission. They are only
+// copied where the pipeline keeps the value, e.g. when it crosses to
+// another scheduler.
+template <size_t N, class P, class Q, class R, class ...Args>
+auto from_signal_ref(const P* qobject, R(Q::*signal)(Args...))
+{
+    static_assert(std::is_base_of<Q, P>::value, "Given signal is not member of sender class nor it's base class.");
+    static_assert(N <= sizeof...(Args), "Cannot take larger number of parameter than the signal has.");
+    return signal::detail::from_signal_ref<Q, signal::detail::tuple_take_t<std::tuple<Args...>, N>>::create(static_cast<const Q*>(qobject), signal);
+}
+
+template <class P, class Q, class R, class ...Args>
+auto from_signal_ref(const P* qobject, R(Q::*signal)(Args...))
+{
+    return from_signal_ref<sizeof...(Args)>(qobject, signal);
+}
+
+// Like from_signal(), but collects emissions and delivers them to a worker
+// of sc as vectors: once max_count values have gathered, or max_delay after
+// the first value of a batch. Meant for signals emitted at a high rate on
+// another thread, e.g. with sc = make_qt_event_loop(receiver), where one
+// wakeup then carries many values.
+template <size_t N, class P, class Q, class R, class ...Args>
+auto from_signal_batched(const P* qobject, R(Q::*signal)(Args...), rxcpp::schedulers::scheduler sc,
+                         std::size_t max_count = 1024,
+                         rxcpp::schedulers::scheduler::clock_type::duration max_delay = std::chrono::milliseconds(0))
+{
+    static_assert(std::is_base_of<Q, P>::value, "Given signal is not member of sender class nor it's base class.");
+    return signal::detail::batched_signal<signal::detail::signal_factory_t<N, Q, Args...>>::create(static_cast<const Q*>(qobject), signal, std::move(sc), max_count, max_delay);
+}
+
+template <class P, class Q, class R, class ...Args>
+auto from_signal_batched(const P* qobject, R(Q::*signal)(Args...), rxcpp::schedulers::scheduler sc,
+                         std::size_t max_count = 1024,
+                         rxcpp::schedulers::scheduler::clock_type::duration max_delay = std::chrono::milliseconds(0))
+{
+    return from_signal_batched<sizeof...(Args)>(qobject, signal, std::move(sc), max_count, max_delay);
+}
+
+// Like from_signal(), but delivers on a worker of sc and conflates: while a
+// delivery is pending, or the subscriber is still busy with the previous
+// value, new emissions replace the value waiting to go out instead of
+// queueing behind it. The subscriber always gets the latest value, memory
+// stays bounded and no backlog builds up.
+template <size_t N, class P, class Q, class R, class ...Args>
+auto from_signal_latest(const P* qobject, R(Q::*signal)(Args...), rxcpp::schedulers::scheduler sc)
+{
+    static_assert(std::is_base_of<Q, P>::value, "Given signal is not member of sender class nor it's base class.");
+    return signal::detail::latest_signal<signal::detail::signal_factory_t<N, Q, Args...>>::create(static_cast<const Q*>(qobject), signal, std::move(sc));
+}
+
+template <class P, class Q, class R, class ...Args>
+auto from_signal_latest(const P* qobject, R(Q::*signal)(Args...), rxcpp::schedulers::scheduler sc)
+{
+    return from_signal_latest<sizeof...(Args)>(qobject, signal, std::move(sc));
+}
+
+// Like from_signal(), but all subscribers share a single connection per
+// sender and signal, and each emission builds its value once.
+template <size_t N, class P, class Q, class R, class ...Args>
+auto from_signal_shared(const P* qobject, R(Q::*signal)(Args...))
+{
+    static_assert(std::is_base_of<Q, P>::value, "Given signal is not member of sender class nor it's base class.");
+    return signal::detail::shared_signal<signal::detail::signal_factory_t<N, Q, Args...>>::create(static_cast<const Q*>(qobject), signal);
+}
+
+template <class P, class Q, class R, class ...Args>
+auto from_signal_shared(const P* qobject, R(Q::*signal)(Args...))
+{
+    return from_signal_shared<sizeof...(Args)>(qobject, signal);
+}
+
 } // rxqt
 
 #endif // RXQT_SIGNAL_HPP
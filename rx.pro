@@ -20,6 +20,8 @@ SOURCES += \
 HEADERS += \
     include/rxqt.hpp \
     include/rxqt_signal.hpp \
+    include/rxqt_metasignal.hpp \
+    include/rxqt_property.hpp \
     include/rxqt_event.hpp \
     include/rxqt-eventloop.hpp \
     include/rx-drop_map.hpp \
@@ -4,6 +4,8 @@
 #include <QtTest/QtTest>
 #include <locale>
 
+Q_LOGGING_CATEGORY(rxqtEventLoop, "rxqt.eventloop")
+
 char whitespace(char c) {
     return std::isspace<char>(c, std::locale::classic());
 }
@@ -41,6 +43,7 @@ namespace rxt = rxcpp::test;
 class TestObservable : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY(int number READ number WRITE setNumber NOTIFY numberChanged)
 private slots:
     void fromsignal_nullary()
     {
@@ -156,6 +159,280 @@ private slots:
         QVERIFY(completed);
     }
 
+    void fromSignal_unsubscribe_disconnects()
+    {
+        TestObservable subject;
+        for (int i = 0; i != 100; ++i) {
+            rxqt::from_signal(&subject, &TestObservable::signal_unary_int).subscribe([](int) {}).unsubscribe();
+        }
+        QCOMPARE(subject.receivers(SIGNAL(signal_unary_int(int))), 0);
+        QCOMPARE(subject.receivers(SIGNAL(destroyed(QObject*))), 0);
+
+        int received = 0;
+        auto subscription = rxqt::from_signal(&subject, &TestObservable::signal_unary_int).subscribe([&](int) { ++received; });
+        emit subject.signal_unary_int(1);
+        subscription.unsubscribe();
+        emit subject.signal_unary_int(2);
+        QCOMPARE(received, 1);
+    }
+
+    void fromSignal_shared()
+    {
+        TestObservable subject;
+        std::vector<int> first, second;
+        auto a = rxqt::from_signal_shared(&subject, &TestObservable::signal_unary_int).subscribe([&](int v) { first.push_back(v); });
+        auto b = rxqt::from_signal_shared(&subject, &TestObservable::signal_unary_int).subscribe([&](int v) { second.push_back(v); });
+        QCOMPARE(subject.receivers(SIGNAL(signal_unary_int(int))), 1);
+        emit subject.signal_unary_int(1);
+        a.unsubscribe();
+        emit subject.signal_unary_int(2);
+        QCOMPARE(first, std::vector<int>{1});
+        QCOMPARE(second, (std::vector<int>{1, 2}));
+        b.unsubscribe();
+        QCOMPARE(subject.receivers(SIGNAL(signal_unary_int(int))), 0);
+        QCOMPARE(subject.receivers(SIGNAL(destroyed(QObject*))), 0);
+
+        // nullary signals count from 0 for every subscriber, late ones too
+        std::vector<long> early, late;
+        auto c = rxqt::from_signal_shared(&subject, &TestObservable::signal_nullary).subscribe([&](long n) { early.push_back(n); });
+        emit subject.signal_nullary();
+        emit subject.signal_nullary();
+        auto d = rxqt::from_signal_shared(&subject, &TestObservable::signal_nullary).subscribe([&](long n) { late.push_back(n); });
+        emit subject.signal_nullary();
+        QCOMPARE(early, (std::vector<long>{0, 1, 2}));
+        QCOMPARE(late, std::vector<long>{0});
+        c.unsubscribe();
+        d.unsubscribe();
+
+        bool completed = false;
+        {
+            TestObservable sender;
+            rxqt::from_signal_shared(&sender, &TestObservable::signal_binary).subscribe([](std::tuple<int, QString>) {}, [&]() { completed = true; });
+        }
+        QVERIFY(completed);
+    }
+
+    void fromSignal_ref()
+    {
+        TestObservable subject;
+        bool viewed = false;
+        std::vector<rxqt::signal_args<int, const QString&>> kept;
+        auto subscription = rxqt::from_signal_ref(&subject, &TestObservable::signal_binary).subscribe([&](const rxqt::signal_args<int, const QString&>& args) {
+            QVERIFY(!args.owns());
+            QCOMPARE(args.get<0>(), 1);
+            QCOMPARE(args.get<1>(), QString("string"));
+            viewed = true;
+            kept.push_back(args);
+        });
+        {
+            QString temporary("string");
+            emit subject.signal_binary(1, temporary);
+        }
+        QVERIFY(viewed);
+        QCOMPARE(kept.size(), size_t(1));
+        QVERIFY(kept[0].owns());
+        QCOMPARE(kept[0].get<1>(), QString("string"));
+        QCOMPARE(kept[0].to_tuple(), std::make_tuple(1, QString("string")));
+        subscription.unsubscribe();
+    }
+
+    void fromSignal_batched()
+    {
+        std::vector<std::vector<int>> batches;
+        bool completed = false;
+        {
+            TestObservable subject;
+            rxqt::from_signal_batched(&subject, &TestObservable::signal_unary_int, rxsc::make_qt_event_loop(), 4).subscribe([&](const std::vector<int>& batch) {
+                batches.push_back(batch);
+            }, [&]() { completed = true; });
+            for (int i = 0; i != 10; ++i) {
+                emit subject.signal_unary_int(i);
+            }
+            QVERIFY(batches.empty());
+            QTRY_COMPARE(batches.size(), size_t(3));
+        }
+        QCOMPARE(batches[0], (std::vector<int>{0, 1, 2, 3}));
+        QCOMPARE(batches[2], (std::vector<int>{8, 9}));
+        QTRY_VERIFY(completed);
+    }
+
+    void fromSignal_batched_timed_flush()
+    {
+        TestObservable subject;
+        std::vector<std::vector<int>> batches;
+        auto subscription = rxqt::from_signal_batched(&subject, &TestObservable::signal_unary_int, rxsc::make_qt_event_loop(), 2, std::chrono::milliseconds(100)).subscribe([&](const std::vector<int>& batch) {
+            batches.push_back(batch);
+        });
+        // cut by count, the timed flush it armed must not cut the next one short
+        emit subject.signal_unary_int(0);
+        emit subject.signal_unary_int(1);
+        QTRY_COMPARE(batches.size(), size_t(1));
+        QTest::qWait(60);
+        emit subject.signal_unary_int(2);
+        QTest::qWait(70);
+        QCOMPARE(batches.size(), size_t(1));
+        QTRY_COMPARE(batches.size(), size_t(2));
+        QCOMPARE(batches[1], std::vector<int>{2});
+        subscription.unsubscribe();
+    }
+
+    void fromSignal_latest()
+    {
+        std::vector<int> received;
+        bool completed = false;
+        {
+            TestObservable subject;
+            rxqt::from_signal_latest(&subject, &TestObservable::signal_unary_int, rxsc::make_qt_event_loop()).subscribe([&](int v) {
+                received.push_back(v);
+            }, [&]() { completed = true; });
+            for (int i = 0; i != 100; ++i) {
+                emit subject.signal_unary_int(i);
+            }
+            QTRY_COMPARE(received, std::vector<int>{99});
+            emit subject.signal_unary_int(100);
+        }
+        QTRY_VERIFY(completed);
+        QCOMPARE(received, (std::vector<int>{99, 100}));
+    }
+
+    void fromSignal_runtime()
+    {
+        TestObservable subject;
+        QList<QVariantList> received;
+        auto byName = rxqt::from_signal(&subject, "signal_binary").subscribe([&](const QVariantList& args) {
+            received << args;
+        });
+        auto bySignature = rxqt::from_signal(&subject, SIGNAL(signal_unary_int(int))).subscribe([&](const QVariantList& args) {
+            received << args;
+        });
+        emit subject.signal_binary(1, QString("string"));
+        emit subject.signal_unary_int(2);
+        byName.unsubscribe();
+        bySignature.unsubscribe();
+        emit subject.signal_unary_int(3);
+        QCOMPARE(received, (QList<QVariantList>() << (QVariantList() << 1 << QString("string")) << (QVariantList() << 2)));
+
+        bool failed = false;
+        rxqt::from_signal(&subject, "no_such_signal").subscribe([](const QVariantList&) {}, [&](std::exception_ptr) { failed = true; });
+        QVERIFY(failed);
+    }
+
+    void fromProperty()
+    {
+        TestObservable subject;
+        subject.setNumber(1);
+        std::vector<int> typed;
+        QVariantList named;
+        auto a = rxqt::from_property(&subject, &TestObservable::number, &TestObservable::numberChanged).subscribe([&](int v) { typed.push_back(v); });
+        auto b = rxqt::from_property(&subject, "number").subscribe([&](const QVariant& v) { named << v; });
+        auto c = rxqt::from_property(&subject, "number").subscribe([](const QVariant&) {});
+        QCOMPARE(subject.receivers(SIGNAL(numberChanged())), 2);
+        subject.setNumber(2);
+        subject.setNumber(2);
+        subject.setNumber(3);
+        QCOMPARE(typed, (std::vector<int>{1, 2, 3}));
+        QCOMPARE(named, (QVariantList() << 1 << 2 << 3));
+
+        // a new subscriber starts with the current value, not the last
+        // notified one, and the others catch up
+        subject.setNumberQuietly(4);
+        std::vector<int> late;
+        auto d = rxqt::from_property(&subject, &TestObservable::number, &TestObservable::numberChanged).subscribe([&](int v) { late.push_back(v); });
+        QCOMPARE(late, std::vector<int>{4});
+        QCOMPARE(typed, (std::vector<int>{1, 2, 3, 4}));
+
+        // a getter that observes a property itself, on a hub of its own
+        std::vector<int> doubled;
+        auto e = rxqt::from_property(&subject, &TestObservable::twice, &TestObservable::numberChanged).subscribe([&](int v) { doubled.push_back(v); });
+        subject.setNumber(5);
+        QCOMPARE(doubled, (std::vector<int>{8, 10}));
+        QCOMPARE(late, (std::vector<int>{4, 5}));
+
+        a.unsubscribe();
+        b.unsubscribe();
+        c.unsubscribe();
+        d.unsubscribe();
+        e.unsubscribe();
+        QCOMPARE(subject.receivers(SIGNAL(numberChanged())), 0);
+    }
+
+    void fromEvent()
+    {
+        auto target = new QObject;
+        const auto other = static_cast<QEvent::Type>(QEvent::User + 1);
+        int user = 0, others = 0;
+        bool completed = false;
+        auto a = rxqt::from_event(target, QEvent::User).subscribe([&](QEvent*) { ++user; });
+        auto b = rxqt::from_event(target, QEvent::User).subscribe([&](QEvent*) { ++user; });
+        auto c = rxqt::from_event(target, other).subscribe([&](QEvent*) { ++others; }, [&]() { completed = true; });
+        QCOMPARE(target->children().size(), 1);
+
+        QEvent e(QEvent::User);
+        QCoreApplication::sendEvent(target, &e);
+        QCOMPARE(user, 2);
+        QCOMPARE(others, 0);
+        a.unsubscribe();
+        QCoreApplication::sendEvent(target, &e);
+        QCOMPARE(user, 3);
+
+        // the dispatcher goes once nobody listens
+        b.unsubscribe();
+        c.unsubscribe();
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        QCOMPARE(target->children().size(), 0);
+        QVERIFY(!completed);
+
+        auto d = rxqt::from_event(target, other).subscribe([&](QEvent*) { ++others; }, [&]() { completed = true; });
+        QEvent o(other);
+        QCoreApplication::sendEvent(target, &o);
+        QCOMPARE(others, 1);
+        delete target;
+        QVERIFY(completed);
+        QVERIFY(!d.is_subscribed());
+    }
+
+    void fromEvent_types()
+    {
+        QObject target;
+        const auto other = static_cast<QEvent::Type>(QEvent::User + 1);
+        QList<int> received;
+        // a type listed twice is delivered once
+        auto s = rxqt::from_event(&target, {QEvent::User, other, QEvent::User}).subscribe([&](QEvent* e) { received << e->type(); });
+        QEvent e(QEvent::User), o(other), ignored(static_cast<QEvent::Type>(QEvent::User + 2));
+        QCoreApplication::sendEvent(&target, &e);
+        QCoreApplication::sendEvent(&target, &ignored);
+        QCoreApplication::sendEvent(&target, &o);
+        QCOMPARE(received, (QList<int>() << QEvent::User << other));
+        s.unsubscribe();
+    }
+
+    void fromApplicationEvent()
+    {
+        auto target = new QObject;
+        QObject bystander;
+        const auto other = static_cast<QEvent::Type>(QEvent::User + 1);
+        QList<QObject*> receivers;
+        int own = 0;
+        bool completed = false;
+        auto a = rxqt::from_application_event({QEvent::User, other}).subscribe([&](std::tuple<QObject*, QEvent*> e) { receivers << std::get<0>(e); });
+        auto b = rxqt::from_application_event(target, {other}).subscribe([&](QEvent*) { ++own; }, [&]() { completed = true; });
+        // nothing installed on the object itself
+        QCOMPARE(target->children().size(), 0);
+
+        QEvent e(QEvent::User), o(other), ignored(static_cast<QEvent::Type>(QEvent::User + 2));
+        QCoreApplication::sendEvent(target, &e);
+        QCoreApplication::sendEvent(&bystander, &o);
+        QCoreApplication::sendEvent(target, &o);
+        QCoreApplication::sendEvent(target, &ignored);
+        QCOMPARE(receivers, (QList<QObject*>() << target << &bystander << target));
+        QCOMPARE(own, 1);
+
+        delete target;
+        QVERIFY(completed);
+        QVERIFY(!b.is_subscribed());
+        a.unsubscribe();
+    }
+
     void add_to()
     {
         bool called = false;
@@ -174,6 +451,772 @@ private slots:
         QVERIFY(!completed);
     }
 
+    void qt_event_loop_on_thread()
+    {
+        QThread thread;
+        thread.start();
+        {
+            std::atomic<QThread*> ranOn(nullptr);
+            rx::composite_subscription cs;
+            auto w = rxsc::make_qt_event_loop(&thread).create_worker(cs);
+            w.schedule([&](const rxsc::schedulable&) {
+                ranOn = QThread::currentThread();
+            });
+            QTRY_VERIFY(ranOn.load() != nullptr);
+            QCOMPARE(ranOn.load(), &thread);
+            cs.unsubscribe();
+        }
+        thread.quit();
+        thread.wait();
+    }
+
+    void qt_event_loop_thread_gone()
+    {
+        auto thread = new QThread;
+        auto sc = rxsc::make_qt_event_loop(thread);
+        delete thread;
+        QTest::ignoreMessage(QtWarningMsg, "rxqt: the thread of a qt_event_loop scheduler is gone, its new worker is unsubscribed");
+        rx::composite_subscription cs;
+        auto w = sc.create_worker(cs);
+        QVERIFY(!cs.is_subscribed());
+        // not run on this thread instead
+        bool ran = false;
+        rx::composite_subscription item;
+        w.schedule(rxsc::make_schedulable(w, item, [&](const rxsc::schedulable&) { ran = true; }));
+        w.schedule(w.now() + std::chrono::milliseconds(1), rxsc::make_schedulable(w, item, [&](const rxsc::schedulable&) { ran = true; }));
+        QTest::qWait(20);
+        QVERIFY(!ran);
+    }
+
+    void qt_event_loop_fifo()
+    {
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop().create_worker(cs);
+        const int producers = 4;
+        const int count = 1000;
+        std::vector<std::vector<int>> seen(producers);
+        std::atomic<int> ran(0);
+        std::vector<std::thread> threads;
+        for (int p = 0; p != producers; ++p) {
+            threads.emplace_back([&, p]() {
+                for (int i = 0; i != count; ++i) {
+                    w.schedule([&, p, i](const rxsc::schedulable&) {
+                        seen[p].push_back(i);
+                        ++ran;
+                    });
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        QTRY_COMPARE(ran.load(), producers * count);
+        for (auto& s : seen) {
+            QCOMPARE(int(s.size()), count);
+            QVERIFY(std::is_sorted(s.begin(), s.end()));
+        }
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_recursion_keeps_order()
+    {
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop().create_worker(cs);
+        QStringList order;
+        int left = 3;
+        w.schedule([&](const rxsc::schedulable& self) {
+            order << "a";
+            if (--left > 0) {
+                self();
+            }
+        });
+        w.schedule([&](const rxsc::schedulable&) { order << "b"; });
+        // a waits behind b once, then recurses with nothing queued
+        QTRY_COMPARE(order, QStringList() << "a" << "b" << "a" << "a");
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_drain_budget_data()
+    {
+        QTest::addColumn<int>("items");
+        QTest::addColumn<int>("micros");
+        QTest::addColumn<int>("firstPass");
+        QTest::newRow("max_items_per_drain") << 3 << 0 << 3;
+        QTest::newRow("max_drain_time") << 0 << 1000 << 1;
+    }
+
+    void qt_event_loop_drain_budget()
+    {
+        QFETCH(int, items);
+        QFETCH(int, micros);
+        QFETCH(int, firstPass);
+        rxsc::qt_event_loop_options options;
+        options.max_items_per_drain = items;
+        options.max_drain_time = std::chrono::microseconds(micros);
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        std::vector<int> ran;
+        for (int i = 0; i != 10; ++i) {
+            w.schedule([&, i](const rxsc::schedulable&) {
+                ran.push_back(i);
+                std::this_thread::sleep_for(std::chrono::microseconds(2 * micros));
+            });
+        }
+        // posted behind the first wakeup, so it sees where that pass yielded
+        QObject marker;
+        int seenAt = -1;
+        auto s = rxqt::from_event(&marker, QEvent::User).subscribe([&](QEvent*) { seenAt = int(ran.size()); });
+        QCoreApplication::postEvent(&marker, new QEvent(QEvent::User));
+        QTRY_COMPARE(int(ran.size()), 10);
+        QCOMPARE(seenAt, firstPass);
+        QCOMPARE(ran, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+        if (items) {
+            QCOMPARE(options.stats->item_budget_hits.load(), std::uint64_t(3));
+            QCOMPARE(options.stats->time_budget_hits.load(), std::uint64_t(0));
+        } else {
+            QVERIFY(options.stats->time_budget_hits.load() >= 9);
+        }
+        s.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_timer_rounding()
+    {
+        using std::chrono::microseconds;
+        using std::chrono::milliseconds;
+        QCOMPARE(rxsc::detail::qt_ceil_milliseconds(microseconds(0)), milliseconds(0));
+        QCOMPARE(rxsc::detail::qt_ceil_milliseconds(microseconds(1)), milliseconds(1));
+        QCOMPARE(rxsc::detail::qt_ceil_milliseconds(microseconds(900)), milliseconds(1));
+        QCOMPARE(rxsc::detail::qt_ceil_milliseconds(microseconds(1000)), milliseconds(1));
+        QCOMPARE(rxsc::detail::qt_ceil_milliseconds(microseconds(1001)), milliseconds(2));
+
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(rxsc::qt_event_loop_options()).create_worker(cs);
+        std::vector<rxsc::scheduler::clock_type::duration> lateness;
+        for (int i = 0; i != 20; ++i) {
+            auto due = w.now() + microseconds(100 + 50 * i);
+            w.schedule(due, [&, due](const rxsc::schedulable&) {
+                lateness.push_back(rxsc::scheduler::clock_type::now() - due);
+            });
+        }
+        QTRY_COMPARE(int(lateness.size()), 20);
+        for (auto late : lateness) {
+            QVERIFY(late >= rxsc::scheduler::clock_type::duration(0));
+        }
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_timer_not_restarted()
+    {
+        using std::chrono::milliseconds;
+        rxsc::qt_event_loop_options options;
+        options.tracer = std::make_shared<rxsc::qt_event_loop_tracer>();
+        auto count = [&](rxsc::qt_event_loop_tracer::event_kind kind) {
+            int n = 0;
+            for (auto& r : options.tracer->snapshot()) {
+                n += r.kind == kind ? 1 : 0;
+            }
+            return n;
+        };
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        auto start = w.now();
+        int ran = 0;
+        w.schedule(start + milliseconds(200), [&](const rxsc::schedulable&) { ++ran; });
+        QCoreApplication::processEvents();
+        QCOMPARE(count(rxsc::qt_event_loop_tracer::timer_armed), 1);
+
+        // later deadlines leave the timer alone
+        for (int i = 1; i != 5; ++i) {
+            w.schedule(start + milliseconds(200 + 10 * i), [&](const rxsc::schedulable&) { ++ran; });
+            QCoreApplication::processEvents();
+        }
+        QCOMPARE(count(rxsc::qt_event_loop_tracer::timer_armed), 1);
+        QCOMPARE(count(rxsc::qt_event_loop_tracer::timer_killed), 0);
+
+        // an earlier one moves it
+        w.schedule(start + milliseconds(100), [&](const rxsc::schedulable&) { ++ran; });
+        QCoreApplication::processEvents();
+        QCOMPARE(count(rxsc::qt_event_loop_tracer::timer_armed), 2);
+        QCOMPARE(count(rxsc::qt_event_loop_tracer::timer_killed), 1);
+        QTRY_COMPARE(ran, 6);
+        cs.unsubscribe();
+    }
+
+    void qt_timer_wheel()
+    {
+        using std::chrono::microseconds;
+        using std::chrono::milliseconds;
+        typedef rxsc::scheduler::clock_type clock_type;
+        auto origin = clock_type::now();
+        rxsc::detail::qt_timer_wheel wheel(origin);
+        rx::composite_subscription cs;
+        auto w = rxsc::make_current_thread().create_worker(cs);
+        auto entry = [&](clock_type::duration d, std::uint64_t id) {
+            auto e = std::make_shared<rxsc::detail::qt_timed_entry>(origin + d, rxsc::make_schedulable(w, [](const rxsc::schedulable&) {}), id);
+            wheel.push(e);
+            return e;
+        };
+
+        // across level 0, the level 1 to 3 boundaries and into the overflow
+        const std::vector<clock_type::duration> deadlines = {
+            microseconds(500), milliseconds(5), milliseconds(5), milliseconds(63), milliseconds(64),
+            milliseconds(65), milliseconds(4095), milliseconds(4096), milliseconds(300000), milliseconds(17000000)
+        };
+        for (std::size_t i = 0; i != deadlines.size(); ++i) {
+            entry(deadlines[i], i + 1);
+        }
+        auto cancel = [&](const std::shared_ptr<rxsc::detail::qt_timed_entry>& e) {
+            e->cancelled = true;
+            e->what.reset();
+            wheel.cancel(e);
+        };
+        cancel(entry(milliseconds(3), 100));
+        cancel(entry(milliseconds(100), 101));
+        cancel(entry(milliseconds(20000000), 102));
+        QCOMPARE(wheel.live(), deadlines.size());
+
+        clock_type::time_point next;
+        QVERIFY(wheel.next_deadline(next));
+        QCOMPARE(next, origin + milliseconds(1));
+
+        std::vector<std::uint64_t> order;
+        for (std::size_t i = 0; i != deadlines.size(); ++i) {
+            auto due = origin + deadlines[i];
+            // whole ticks, so an entry comes out at the end of its millisecond
+            auto ready = origin + rxsc::detail::qt_ceil_milliseconds(deadlines[i]);
+            QVERIFY(wheel.next_deadline(next));
+            QVERIFY(next <= ready);
+            std::vector<rxsc::detail::qt_queued_item> out;
+            wheel.take_due(due - microseconds(1), out);
+            QVERIFY(out.empty());
+            wheel.take_due(ready, out);
+            for (auto& item : out) {
+                order.push_back(item.id);
+            }
+            QVERIFY(std::find(order.begin(), order.end(), i + 1) != order.end());
+        }
+        QCOMPARE(order, (std::vector<std::uint64_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+        QCOMPARE(wheel.live(), std::size_t(0));
+        QVERIFY(!wheel.next_deadline(next));
+
+        // filed relative to where the wheel stands now
+        auto now = origin + milliseconds(17000000);
+        entry(milliseconds(17000000) + microseconds(2500), 200);
+        QVERIFY(wheel.next_deadline(next));
+        QCOMPARE(next, now + milliseconds(3));
+        std::vector<rxsc::detail::qt_queued_item> out;
+        wheel.take_due(now + milliseconds(2), out);
+        QVERIFY(out.empty());
+        wheel.take_due(now + milliseconds(3), out);
+        QCOMPARE(int(out.size()), 1);
+        QCOMPARE(out.front().id, std::uint64_t(200));
+
+        // a level 1 entry cascades before a later level 0 one comes due
+        rxsc::detail::qt_timer_wheel mixed(origin);
+        auto push = [&](clock_type::duration d, std::uint64_t id) {
+            mixed.push(std::make_shared<rxsc::detail::qt_timed_entry>(origin + d, rxsc::make_schedulable(w, [](const rxsc::schedulable&) {}), id));
+        };
+        push(milliseconds(100), 300);
+        out.clear();
+        mixed.take_due(origin + milliseconds(60), out);
+        QVERIFY(out.empty());
+        push(milliseconds(120), 301);
+        QVERIFY(mixed.next_deadline(next));
+        QCOMPARE(next, origin + milliseconds(64));
+        mixed.take_due(next, out);
+        QVERIFY(out.empty());
+        QVERIFY(mixed.next_deadline(next));
+        QCOMPARE(next, origin + milliseconds(100));
+        mixed.take_due(next, out);
+        QCOMPARE(int(out.size()), 1);
+        QCOMPARE(out.front().id, std::uint64_t(300));
+        cs.unsubscribe();
+    }
+
+    void qt_timed_heap_compaction()
+    {
+        rxsc::qt_event_loop_options options;
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        auto start = w.now();
+        std::vector<rx::composite_subscription> items(200);
+        std::vector<int> ran;
+        for (int i = 0; i != 200; ++i) {
+            auto when = start + std::chrono::milliseconds(200) + std::chrono::microseconds(100 * i);
+            w.schedule(when, rxsc::make_schedulable(w, items[i], [&ran, i](const rxsc::schedulable&) { ran.push_back(i); }));
+        }
+        auto live = [&]() { return options.stats->timed_live.load(); };
+        auto dead = [&]() { return options.stats->timed_dead.load(); };
+        QCOMPARE(live(), std::int64_t(200));
+        QCOMPARE(dead(), std::int64_t(0));
+
+        // tombstones up to half the heap stay
+        for (int i = 1; i < 200; i += 2) {
+            items[i].unsubscribe();
+        }
+        QCOMPARE(live(), std::int64_t(100));
+        QCOMPARE(dead(), std::int64_t(100));
+        // one more and they are compacted away
+        items[2].unsubscribe();
+        QCOMPARE(live(), std::int64_t(99));
+        QCOMPARE(dead(), std::int64_t(0));
+        // a cancelled head is popped right away
+        items[0].unsubscribe();
+        QCOMPARE(live(), std::int64_t(98));
+        QCOMPARE(dead(), std::int64_t(0));
+        // cancelling twice changes nothing
+        items[0].unsubscribe();
+        QCOMPARE(live(), std::int64_t(98));
+
+        std::vector<int> expected;
+        for (int i = 4; i < 200; i += 2) {
+            expected.push_back(i);
+        }
+        QTRY_COMPARE(int(ran.size()), 98);
+        QCOMPARE(ran, expected);
+        QCOMPARE(live(), std::int64_t(0));
+        QCOMPARE(dead(), std::int64_t(0));
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_inline_order()
+    {
+        rxsc::qt_event_loop_options options;
+        options.inline_when_idle = true;
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        QStringList order;
+        // idle, so it runs right away
+        w.schedule([&](const rxsc::schedulable&) { order << "inline"; });
+        QCOMPARE(order, QStringList() << "inline");
+
+        // behind an item queued from another thread
+        std::thread([&]() {
+            w.schedule([&](const rxsc::schedulable&) { order << "queued"; });
+        }).join();
+        w.schedule([&](const rxsc::schedulable&) { order << "after queued"; });
+        QCOMPARE(order.size(), 1);
+        QTRY_COMPARE(order.size(), 3);
+
+        // behind a timed item that came due
+        w.schedule(w.now() + std::chrono::milliseconds(1), [&](const rxsc::schedulable&) { order << "due"; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        w.schedule([&](const rxsc::schedulable&) { order << "after due"; });
+        QCOMPARE(order.size(), 3);
+        QTRY_COMPARE(order.size(), 5);
+
+        // behind the running item
+        w.schedule([&](const rxsc::schedulable&) {
+            order << "outer";
+            w.schedule([&](const rxsc::schedulable&) { order << "nested"; });
+            order << "outer done";
+        });
+        QTRY_COMPARE(order.size(), 8);
+        QCOMPARE(order, QStringList() << "inline" << "queued" << "after queued" << "due" << "after due"
+                                      << "outer" << "outer done" << "nested");
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_tracer()
+    {
+        typedef rxsc::qt_event_loop_tracer tracer_type;
+        auto items = [](const std::vector<tracer_type::record>& records) {
+            std::vector<std::uint64_t> result;
+            for (auto& r : records) {
+                result.push_back(r.item);
+            }
+            return result;
+        };
+
+        // 3 rounds up to 4
+        tracer_type tracer(3);
+        tracer.trace(tracer_type::scheduled, &tracer, 1);
+        tracer.trace(tracer_type::run_begin, &tracer, 2);
+        tracer.trace(tracer_type::run_end, &tracer, 3);
+        auto records = tracer.snapshot();
+        QCOMPARE(int(records.size()), 3);
+        QCOMPARE(records[0].kind, tracer_type::scheduled);
+        QCOMPARE(records[1].kind, tracer_type::run_begin);
+        QCOMPARE(records[2].kind, tracer_type::run_end);
+        QCOMPARE(records[0].worker, static_cast<const void*>(&tracer));
+        QVERIFY(records[0].timestamp <= records[1].timestamp && records[1].timestamp <= records[2].timestamp);
+
+        // once wrapped, the oldest records are gone
+        for (std::uint64_t i = 4; i != 11; ++i) {
+            tracer.trace(tracer_type::scheduled, &tracer, i);
+        }
+        QCOMPARE(items(tracer.snapshot()), (std::vector<std::uint64_t>{7, 8, 9, 10}));
+
+        // a worker's records, following one item by its id
+        rxsc::qt_event_loop_options options;
+        options.tracer = std::make_shared<tracer_type>();
+        options.watchdog = std::make_shared<rxsc::qt_event_loop_watchdog>(std::chrono::microseconds(0));
+        std::vector<std::uint64_t> reported;
+        auto stalls = options.watchdog->stalls().subscribe([&](const rxsc::qt_event_loop_stall& stall) {
+            reported.push_back(stall.item);
+        });
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        w.schedule([](const rxsc::schedulable&) {});
+        QTRY_COMPARE(int(reported.size()), 1);
+        records = options.tracer->snapshot();
+        std::vector<tracer_type::event_kind> kinds;
+        for (auto& r : records) {
+            kinds.push_back(r.kind);
+        }
+        QCOMPARE(kinds, (std::vector<tracer_type::event_kind>{tracer_type::scheduled, tracer_type::wakeup_posted, tracer_type::drain_begin,
+                                                              tracer_type::run_begin, tracer_type::run_end, tracer_type::drain_end}));
+        QVERIFY(records[0].item != 0);
+        QCOMPARE(records[3].item, records[0].item);
+        QCOMPARE(reported.front(), records[0].item);
+
+        // without a tracer nothing is recorded and items carry no id
+        options.tracer.reset();
+        auto untraced = rxsc::make_qt_event_loop(options).create_worker(cs);
+        untraced.schedule([](const rxsc::schedulable&) {});
+        QTRY_COMPARE(int(reported.size()), 2);
+        QCOMPARE(reported.back(), std::uint64_t(0));
+        stalls.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_recycled_state()
+    {
+        typedef rxsc::qt_event_loop_tracer tracer_type;
+        rxsc::qt_event_loop_options options;
+        options.tracer = std::make_shared<tracer_type>();
+        auto sc = rxsc::make_qt_event_loop(options);
+
+        // a worker that armed and used a timer, ended while idle
+        const void* first = nullptr;
+        {
+            rx::composite_subscription cs;
+            auto w = sc.create_worker(cs);
+            int ran = 0;
+            w.schedule([&](const rxsc::schedulable&) { ++ran; });
+            w.schedule(w.now() + std::chrono::milliseconds(10), [&](const rxsc::schedulable&) { ++ran; });
+            QTRY_COMPARE(ran, 2);
+            QCoreApplication::processEvents();
+            first = options.tracer->snapshot().front().worker;
+            cs.unsubscribe();
+        }
+        auto seen = options.tracer->snapshot().size();
+
+        // the next worker gets the same state: no timer, nothing queued,
+        // recursion off until its queue is empty
+        rx::composite_subscription cs;
+        auto w = sc.create_worker(cs);
+        QStringList order;
+        int left = 3;
+        w.schedule([&](const rxsc::schedulable& self) {
+            order << "a";
+            if (--left > 0) {
+                self();
+            }
+        });
+        w.schedule([&](const rxsc::schedulable&) { order << "b"; });
+        QTRY_COMPARE(order, QStringList() << "a" << "b" << "a" << "a");
+        QTest::qWait(30);
+        QCOMPARE(order, QStringList() << "a" << "b" << "a" << "a");
+
+        auto records = options.tracer->snapshot();
+        QVERIFY(records.size() > seen);
+        QCOMPARE(records[seen].kind, tracer_type::scheduled);
+        for (auto i = seen; i != records.size(); ++i) {
+            QCOMPARE(records[i].worker, first);
+            QVERIFY(records[i].kind != tracer_type::timer_fired);
+            QVERIFY(records[i].kind != tracer_type::timer_armed);
+        }
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_priority_lanes()
+    {
+        auto lane = [](rxsc::qt_event_loop_priority priority) {
+            rxsc::qt_event_loop_options options;
+            options.priority = priority;
+            return rxsc::make_qt_event_loop(options);
+        };
+        rx::composite_subscription cs;
+        auto background = lane(rxsc::qt_event_loop_priority::background).create_worker(cs);
+        auto normal = lane(rxsc::qt_event_loop_priority::normal).create_worker(cs);
+        auto interactive = lane(rxsc::qt_event_loop_priority::interactive).create_worker(cs);
+        QStringList order;
+        for (int i = 0; i != 3; ++i) {
+            background.schedule([&](const rxsc::schedulable&) { order << "background"; });
+            normal.schedule([&](const rxsc::schedulable&) { order << "normal"; });
+            interactive.schedule([&](const rxsc::schedulable&) { order << "interactive"; });
+        }
+        // higher lanes drain first, whatever the order of scheduling
+        QTRY_COMPARE(order.size(), 9);
+        QCOMPARE(order, QStringList() << "interactive" << "interactive" << "interactive"
+                                      << "normal" << "normal" << "normal"
+                                      << "background" << "background" << "background");
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_background_share()
+    {
+        rxsc::qt_event_loop_options options;
+        options.priority = rxsc::qt_event_loop_priority::background;
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        QObject marker;
+        int ran = 0;
+        int seenAt = -1;
+        auto s = rxqt::from_event(&marker, QEvent::User).subscribe([&](QEvent*) { seenAt = ran; });
+        for (int i = 0; i != 100; ++i) {
+            w.schedule([&](const rxsc::schedulable&) {
+                if (ran++ == 0) {
+                    // normal work arriving during a background burst
+                    QCoreApplication::postEvent(&marker, new QEvent(QEvent::User));
+                }
+            });
+        }
+        QTRY_COMPARE(ran, 100);
+        QCOMPARE(seenAt, int(rxsc::qt_event_loop_options::background_items_per_drain));
+        QCOMPARE(options.stats->item_budget_hits.load(), std::uint64_t(3));
+        s.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_metrics()
+    {
+        rxsc::qt_event_loop_options options;
+        options.stats = std::make_shared<rxsc::qt_event_loop_stats>();
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        int ran = 0;
+        for (int i = 0; i != 10; ++i) {
+            w.schedule([&](const rxsc::schedulable&) { ++ran; });
+        }
+        QCOMPARE(options.stats->queue_depth.load(), std::int64_t(10));
+        QTRY_COMPARE(ran, 10);
+        auto m = options.stats->metrics();
+        QCOMPARE(m.queue_depth, std::int64_t(0));
+        QCOMPARE(m.peak_queue_depth, std::int64_t(10));
+        QCOMPARE(m.executed, std::uint64_t(10));
+        QCOMPARE(options.stats->latency.count(), std::uint64_t(10));
+        QVERIFY(m.latency_p50 <= m.latency_max);
+
+        std::vector<rxsc::qt_event_loop_metrics> reports;
+        auto stream = rx::qt_event_loop_metrics_stream(options.stats, std::chrono::milliseconds(1)).subscribe([&](const rxsc::qt_event_loop_metrics& snapshot) {
+            reports.push_back(snapshot);
+        });
+        QTRY_VERIFY(reports.size() >= 2);
+        QCOMPARE(reports.front().executed, std::uint64_t(10));
+        stream.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_watchdog()
+    {
+        rxsc::qt_event_loop_options options;
+        options.watchdog = std::make_shared<rxsc::qt_event_loop_watchdog>(std::chrono::milliseconds(10));
+        options.label = "slow";
+        QStringList labels;
+        auto stalls = options.watchdog->stalls().subscribe([&](const rxsc::qt_event_loop_stall& stall) {
+            labels << stall.label;
+            QVERIFY(stall.duration >= std::chrono::milliseconds(10));
+        });
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        bool ran = false;
+        w.schedule([&](const rxsc::schedulable&) { ran = true; });
+        w.schedule([&](const rxsc::schedulable&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        });
+        QTRY_COMPARE(labels, QStringList() << "slow");
+        QVERIFY(ran);
+        stalls.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_watchdog_reentrant()
+    {
+        rxsc::qt_event_loop_options options;
+        options.watchdog = std::make_shared<rxsc::qt_event_loop_watchdog>(std::chrono::milliseconds(10));
+        rx::composite_subscription cs;
+        auto sc = rxsc::make_qt_event_loop(options);
+        auto first = sc.create_worker(cs);
+        auto second = sc.create_worker(cs);
+        auto slow = [](const rxsc::schedulable&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        };
+        // a subscriber that pumps events, running into another stall
+        int reports = 0;
+        bool nested = false;
+        auto stalls = options.watchdog->stalls().subscribe([&](const rxsc::qt_event_loop_stall&) {
+            if (++reports == 1) {
+                second.schedule(slow);
+                QCoreApplication::processEvents();
+                // the second report waits for this one to return
+                nested = reports == 1;
+            }
+        });
+        first.schedule(slow);
+        QTRY_COMPARE(reports, 2);
+        QVERIFY(nested);
+        stalls.unsubscribe();
+        cs.unsubscribe();
+    }
+
+    void qt_idle_loop_runs_after_events()
+    {
+        QEventLoop loop;
+        QStringList order;
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_idle_loop().create_worker(cs);
+        w.schedule([&](const rxsc::schedulable&) {
+            order << "idle";
+            loop.quit();
+        });
+        QTimer::singleShot(0, [&]() { order << "event"; });
+        QTimer::singleShot(5000, &loop, &QEventLoop::quit);
+        loop.exec();
+        QCOMPARE(order, QStringList() << "event" << "idle");
+        cs.unsubscribe();
+    }
+
+    void qt_idle_loop_releases_items()
+    {
+        auto token = std::make_shared<int>(0);
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_idle_loop().create_worker(cs);
+
+        // a cancelled timed item is let go of right away
+        rx::composite_subscription timeout;
+        w.schedule(w.now() + std::chrono::seconds(10), rxsc::make_schedulable(w, timeout, [token](const rxsc::schedulable&) {}));
+        QCOMPARE(token.use_count(), 2L);
+        timeout.unsubscribe();
+        QCOMPARE(token.use_count(), 1L);
+
+        // and so is everything once the worker ends
+        bool ran = false;
+        w.schedule([token, &ran](const rxsc::schedulable&) { ran = true; });
+        w.schedule(w.now() + std::chrono::seconds(10), [token](const rxsc::schedulable&) {});
+        QCOMPARE(token.use_count(), 3L);
+        cs.unsubscribe();
+        QCOMPARE(token.use_count(), 1L);
+        QCoreApplication::processEvents();
+        QVERIFY(!ran);
+    }
+
+    void qt_idle_loop_needs_dispatcher()
+    {
+        bool thrown = false;
+        std::thread([&]() {
+            rx::composite_subscription cs;
+            try {
+                rxsc::make_qt_idle_loop().create_worker(cs);
+            } catch (const std::logic_error&) {
+                thrown = true;
+            }
+            cs.unsubscribe();
+        }).join();
+        QVERIFY(thrown);
+    }
+
+    void qt_frame_loop_batches()
+    {
+        QStringList order;
+        rx::composite_subscription cs;
+        auto sc = rxsc::make_qt_frame_loop();
+        auto first = sc.create_worker(cs);
+        auto second = sc.create_worker(cs);
+        first.schedule([&](const rxsc::schedulable&) { order << "first"; });
+        QTimer::singleShot(0, [&]() { order << "event"; });
+        second.schedule([&](const rxsc::schedulable&) { order << "second"; });
+        QTRY_COMPARE(order, QStringList() << "event" << "first" << "second");
+        cs.unsubscribe();
+    }
+
+    void qt_frame_loop_one_frame()
+    {
+        typedef rxsc::scheduler::clock_type clock_type;
+        const auto interval = std::chrono::milliseconds(50);
+        // made off the main thread, still runs on it
+        rxsc::scheduler sc = rxsc::make_current_thread();
+        std::thread([&]() { sc = rxsc::make_qt_frame_loop(interval); }).join();
+        rx::composite_subscription cs;
+        auto w = sc.create_worker(cs);
+        std::vector<clock_type::time_point> first, second;
+        int seenByEvent = -1;
+        bool mainThread = true;
+        for (int i = 0; i != 5; ++i) {
+            w.schedule([&](const rxsc::schedulable&) {
+                mainThread = mainThread && QThread::currentThread() == qApp->thread();
+                if (first.empty()) {
+                    QTimer::singleShot(0, [&]() { seenByEvent = int(first.size()); });
+                }
+                first.push_back(clock_type::now());
+                if (first.size() == 5) {
+                    for (int j = 0; j != 5; ++j) {
+                        w.schedule([&](const rxsc::schedulable&) { second.push_back(clock_type::now()); });
+                    }
+                }
+            });
+        }
+        QTRY_COMPARE(int(second.size()), 5);
+        QVERIFY(mainThread);
+        // the whole batch ran before any other event
+        QCOMPARE(seenByEvent, 5);
+        QVERIFY(first.back() - first.front() < interval / 2);
+        QVERIFY(second.back() - second.front() < interval / 2);
+        // work scheduled by a frame waits for the next boundary, one interval on
+        auto gap = second.front() - first.front();
+        QVERIFY(gap >= interval - std::chrono::milliseconds(1));
+        QVERIFY(gap < interval + interval / 2);
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_virtual_time()
+    {
+        rxsc::qt_event_loop_options options;
+        options.clock = std::make_shared<rxsc::qt_virtual_clock>();
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        auto start = w.now();
+        std::vector<int> ran;
+        w.schedule(start + std::chrono::seconds(10), [&](const rxsc::schedulable&) {
+            ran.push_back(10);
+        });
+        w.schedule(start + std::chrono::seconds(5), [&](const rxsc::schedulable&) {
+            ran.push_back(5);
+            // rescheduled relative to virtual time
+            w.schedule(w.now() + std::chrono::seconds(2), [&](const rxsc::schedulable&) {
+                ran.push_back(7);
+            });
+        });
+        options.clock->advance_by(std::chrono::seconds(4));
+        QVERIFY(ran.empty());
+        options.clock->advance_by(std::chrono::seconds(6));
+        QCOMPARE(ran, (std::vector<int>{5, 7, 10}));
+        QCOMPARE(w.now(), start + std::chrono::seconds(10));
+        cs.unsubscribe();
+    }
+
+    void qt_event_loop_virtual_time_other_thread()
+    {
+        // a worker on a thread whose loop is not running does not hold
+        // up advancing the clock
+        QThread stopped;
+        rxsc::qt_event_loop_options options;
+        options.clock = std::make_shared<rxsc::qt_virtual_clock>();
+        options.thread = &stopped;
+        rx::composite_subscription cs;
+        auto w = rxsc::make_qt_event_loop(options).create_worker(cs);
+        bool ran = false;
+        w.schedule(w.now() + std::chrono::seconds(1), [&](const rxsc::schedulable&) { ran = true; });
+        options.clock->advance_by(std::chrono::seconds(2));
+        QVERIFY(!ran);
+        cs.unsubscribe();
+    }
+
     void chunk_by()
     {
         auto sc = rxsc::make_test();
@@ -271,7 +1314,33 @@ private slots:
         QCOMPARE(required, actual);
     }
 
+public:
+    int number() const
+    {
+        return m_number;
+    }
+
+    void setNumber(int number)
+    {
+        m_number = number;
+        emit numberChanged();
+    }
+
+    void setNumberQuietly(int number)
+    {
+        m_number = number;
+    }
+
+    // reads through a subscription of its own
+    int twice() const
+    {
+        int value = 0;
+        rxqt::from_property(this, &TestObservable::number, &TestObservable::numberChanged).first().subscribe([&](int v) { value = v; });
+        return 2 * value;
+    }
+
 signals:
+    void numberChanged();
     void signal_nullary();
     void signal_unary_int(int);
     void signal_unary_string(const QString&);
@@ -280,6 +1349,9 @@ signals:
     void signal_private_nullary(QPrivateSignal);
     void signal_private_unary_int(int, QPrivateSignal);
     void signal_private_binary(int, const QString&, QPrivateSignal);
+
+private:
+    int m_number = 0;
 };
 
 QTEST_GUILESS_MAIN(TestObservable)